@@ -0,0 +1,115 @@
+//
+// Measures task throughput of ThreadPool (single shared queue) against WorkStealingThreadPool (per worker queues)
+//
+// Usage: ThreadPoolBenchmark [tasks count] [work per task]
+//
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ThreadPool/ThreadPool.h"
+#include "ThreadPool/WorkStealingThreadPool.h"
+
+// keeps the compiler from optimising the task work away
+std::atomic<unsigned> sink(0);
+
+// a small amount of work per task so we mostly measure the scheduling cost
+void DoWork(int work, std::atomic<int>& done)
+{
+	unsigned value = 0;
+	for (int i = 0; i < work; i++)
+	{
+		value = value * 1664525u + 1013904223u;
+	}
+
+	sink += value;
+	done++;
+}
+
+// wait until all the tasks have been done
+void WaitForTasks(std::atomic<int>& done, int tasksCount)
+{
+	while (done < tasksCount)
+	{
+		std::this_thread::yield();
+	}
+}
+
+// tasks are added from the main thread and then waited through their ThreadTaskResult
+template<typename Pool>
+double BenchmarkExternalTasks(int tasksCount, int work)
+{
+	Pool pool;
+	std::atomic<int> done(0);
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<ThreadTaskResult> taskResults;
+	taskResults.reserve(tasksCount);
+	for (int i = 0; i < tasksCount; i++)
+	{
+		taskResults.push_back(pool.AddTask([work, &done]() { DoWork(work, done); }));
+	}
+
+	void* result = nullptr;
+	for (auto& taskResult : taskResults)
+	{
+		taskResult.WaitForResult(result);
+	}
+
+	std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+	return tasksCount / seconds.count();
+}
+
+// a few root tasks are added from the main thread and every one of them adds the rest of the tasks from a worker
+template<typename Pool>
+double BenchmarkNestedTasks(int tasksCount, int work)
+{
+	Pool pool;
+	std::atomic<int> done(0);
+
+	const int rootTasksCount = 64;
+	const int childTasksCount = tasksCount / rootTasksCount;
+	const int totalTasks = rootTasksCount * childTasksCount;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < rootTasksCount; i++)
+	{
+		pool.AddTask([&pool, childTasksCount, work, &done]()
+		{
+			for (int j = 0; j < childTasksCount; j++)
+			{
+				pool.AddTask([work, &done]() { DoWork(work, done); });
+			}
+		});
+	}
+
+	WaitForTasks(done, totalTasks);
+
+	std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+	return totalTasks / seconds.count();
+}
+
+int main(int argc, char** argv)
+{
+	int tasksCount = argc > 1 ? std::stoi(argv[1]) : 200000;
+	int work = argc > 2 ? std::stoi(argv[2]) : 100;
+
+	printf("Hardware threads: %u, tasks: %d, work per task: %d\n", std::thread::hardware_concurrency(), tasksCount, work);
+	printf("%-10s %20s %20s\n", "", "ThreadPool", "WorkStealing");
+
+	double external = BenchmarkExternalTasks<ThreadPool>(tasksCount, work);
+	double externalWorkStealing = BenchmarkExternalTasks<WorkStealingThreadPool>(tasksCount, work);
+	printf("%-10s %14.0f tasks/s %14.0f tasks/s\n", "external", external, externalWorkStealing);
+
+	double nested = BenchmarkNestedTasks<ThreadPool>(tasksCount, work);
+	double nestedWorkStealing = BenchmarkNestedTasks<WorkStealingThreadPool>(tasksCount, work);
+	printf("%-10s %14.0f tasks/s %14.0f tasks/s\n", "nested", nested, nestedWorkStealing);
+
+	return 0;
+}
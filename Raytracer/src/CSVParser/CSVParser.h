@@ -1,134 +1,241 @@
 //
-// Note: The core parsing in CsvParser::ParseFile is from https://github.com/andy-thomason/read_a_csv_file  
-// I just added some modifications to be more reusable.
+// Note: The parsing was originally based on https://github.com/andy-thomason/read_a_csv_file
+// It now parses memory mapped files in place so rows and fields are views into the file.
 //
 
 #ifndef CSV_PARSER
 #define CSV_PARSER
 
-#include <fstream>
-#include <vector>
 #include <cassert>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "../Memory/MappedFile.h"
+#include "../Parsing/ParseNumber.h"
+#include "../ThreadPool/WorkStealingThreadPool.h"
 
 namespace agarzonp
 {
+	// Fields of a row, as views into the parsed text
 	class CSVRow
 	{
-		std::vector<std::string> tokens;
+		const std::string_view* tokens;
+		size_t numTokens;
 
 	public:
 
-		void AddToken(const char* start, const char* end)
+		CSVRow(const std::string_view* tokens_, size_t numTokens_)
+			: tokens(tokens_)
+			, numTokens(numTokens_)
 		{
-			tokens.emplace_back(start, end);
 		}
-		
-		const char* operator[] (size_t index) const
+
+		std::string_view operator[] (size_t index) const
 		{
-			assert(index < tokens.size());
+			assert(index < numTokens);
 
-			if (index < tokens.size())
+			if (index < numTokens)
 			{
-				return tokens[index].c_str();
+				return tokens[index];
 			}
 
-			return "";
+			return std::string_view();
 		}
 
-		const size_t NumTokens() const { return tokens.size(); }
-	};
+		// numeric fields. Return false if the field is missing or is not a number
+		bool ToInt(size_t index, int& value) const { return Parsing::ParseInt((*this)[index], value); }
+		bool ToFloat(size_t index, float& value) const { return Parsing::ParseFloat((*this)[index], value); }
 
+		const size_t NumTokens() const { return numTokens; }
+	};
 
+	// Memory maps a CSV file and splits it in rows and fields without copying them
+	// Fields are views into the mapping, so they stay valid as long as the parser
+	// Big files can be split in chunks of lines parsed in parallel on a thread pool
 	class CSVParser
 	{
-		const char* filePath;
+		MappedFile file;
 		bool isValid;
 
-		typedef std::vector<CSVRow> CSVRows;
-		CSVRows rows;
+		// fields of all the rows, and the index of the first field of every row plus one past the last
+		std::vector<std::string_view> tokens;
+		std::vector<size_t> rowStarts;
+
+		// files smaller than this are parsed in a single chunk
+		static const size_t PARALLEL_MIN_BYTES = 1024 * 1024;
 
 	public:
 
-		CSVParser(const char* file, const char delimiter = ',')
-			: filePath(file)
-			, isValid(false)
+		CSVParser(const char* filePath, const char delimiter = ',', WorkStealingThreadPool* threadPool = nullptr)
+			: isValid(false)
+			, rowStarts(1, 0)
 		{
-			ParseFile(filePath, delimiter);
+			ParseFile(filePath, delimiter, threadPool);
 		}
 
-		CSVParser() : isValid(false) {}
+		CSVParser() : isValid(false), rowStarts(1, 0) {}
 
 		~CSVParser()
 		{
 		}
 
-		const CSVRows& Rows() const { return rows; }
+		CSVParser(const CSVParser& other) = delete;
+		CSVParser& operator=(const CSVParser& other) = delete;
 
 		bool IsValid() { return isValid; }
 
-		const CSVRow& operator[](size_t rowIndex)
+		CSVRow operator[](size_t rowIndex) const
 		{
-			assert(rowIndex < rows.size());
-			return rows[rowIndex];
+			assert(rowIndex < NumRows());
+			return CSVRow(tokens.data() + rowStarts[rowIndex], rowStarts[rowIndex + 1] - rowStarts[rowIndex]);
 		}
 
-		size_t NumRows() { return rows.size();  }
-		size_t NumCols() { return rows.size() > 0 ? rows[0].NumTokens() : 0; }
+		size_t NumRows() const { return rowStarts.size() - 1; }
+		size_t NumCols() const { return NumRows() > 0 ? (*this)[0].NumTokens() : 0; }
 
+		// parse a line of text. Its fields are views into it, so the line has to outlive the parser
 		void ParseCSVLine(const char* line, const char delimiter = ',')
 		{
 			isValid = true;
 
-			ParseLine(line, delimiter);
+			rowStarts.pop_back();
+			ParseLines(line, line + strlen(line), delimiter, tokens, rowStarts);
+			rowStarts.push_back(tokens.size());
 		}
 
 	private:
 
-		void ParseFile(const char* file, const char delimiter)
+		void ParseFile(const char* filePath, const char delimiter, WorkStealingThreadPool* threadPool)
 		{
-			std::ifstream is(file);
-
-			if (is.bad() || !is.is_open())
+			if (!file.Open(filePath))
 			{
 				return;
 			}
 
 			isValid = true;
 
-			// store the line here
-			char buffer[2048];
+			const char* begin = file.Data();
+			const char* end = begin + file.Size();
+
+			size_t chunksCount = threadPool && file.Size() >= PARALLEL_MIN_BYTES ? threadPool->NumWorkerThreads() + 1 : 1;
+			if (chunksCount == 1)
+			{
+				rowStarts.pop_back();
+				ParseLines(begin, end, delimiter, tokens, rowStarts);
+				rowStarts.push_back(tokens.size());
+				return;
+			}
+
+			// split in chunks of whole lines, parse them in parallel and append them in order
+			struct Chunk
+			{
+				std::vector<std::string_view> tokens;
+				std::vector<size_t> rowStarts;
+			};
+			std::vector<Chunk> chunks(chunksCount);
+
+			std::vector<const char*> chunkBegins(chunksCount + 1, end);
+			chunkBegins[0] = begin;
+			for (size_t i = 1; i < chunksCount; i++)
+			{
+				chunkBegins[i] = LineStart(chunkBegins[i - 1], begin + file.Size() * i / chunksCount, end);
+			}
+
+			// the first chunk runs in the calling thread and the rest as tasks
+			auto parseChunk = [&chunks, &chunkBegins, delimiter](size_t i)
+			{
+				ParseLines(chunkBegins[i], chunkBegins[i + 1], delimiter, chunks[i].tokens, chunks[i].rowStarts);
+			};
 
-			// loop over lines
-			while (!is.eof()) 
+			std::vector<ThreadTaskResult> taskResults;
+			for (size_t i = 1; i < chunksCount; i++)
 			{
-				is.getline(buffer, sizeof(buffer));
+				taskResults.push_back(threadPool->AddTask([&parseChunk, i]() { parseChunk(i); }));
+			}
+
+			parseChunk(0);
 
-				ParseLine(buffer, delimiter);
+			for (auto& taskResult : taskResults)
+			{
+				threadPool->WaitForTask(taskResult);
 			}
 
-			is.close();
+			size_t tokensCount = 0;
+			size_t rowsCount = 0;
+			for (const Chunk& chunk : chunks)
+			{
+				tokensCount += chunk.tokens.size();
+				rowsCount += chunk.rowStarts.size();
+			}
+
+			tokens.reserve(tokensCount);
+			rowStarts.clear();
+			rowStarts.reserve(rowsCount + 1);
+			for (Chunk& chunk : chunks)
+			{
+				size_t offset = tokens.size();
+				for (size_t rowStart : chunk.rowStarts)
+				{
+					rowStarts.push_back(offset + rowStart);
+				}
+				tokens.insert(tokens.end(), chunk.tokens.begin(), chunk.tokens.end());
+			}
+			rowStarts.push_back(tokens.size());
 		}
 
-		void ParseLine(const char* buffer, const char delimiter)
+		// start of the first line at or after position, but not before begin
+		static const char* LineStart(const char* begin, const char* position, const char* end)
 		{
-			CSVRow row;
+			if (position <= begin)
+			{
+				return begin;
+			}
+
+			const char* lineEnd = static_cast<const char*>(memchr(position - 1, '\n', end - (position - 1)));
+			return lineEnd ? lineEnd + 1 : end;
+		}
 
-			const char *b = buffer;
-			if (*b != '\0') // avoid the empty line
+		// split the lines in [begin, end) in fields, skipping empty lines
+		static void ParseLines(const char* begin, const char* end, const char delimiter, std::vector<std::string_view>& tokens, std::vector<size_t>& rowStarts)
+		{
+			const char* line = begin;
+			while (line < end)
 			{
-				// loop over columns
-				for (int col = 0; ; ++col) {
-					const char *e = b;
-					while (*e != 0 && *e != delimiter) ++e;
+				const char* lineEnd = static_cast<const char*>(memchr(line, '\n', end - line));
+				const char* nextLine = lineEnd ? lineEnd + 1 : end;
+				if (!lineEnd)
+				{
+					lineEnd = end;
+				}
 
-					// now b -> e contains the chars in a column
-					row.AddToken(b, e);
+				// Windows line endings
+				if (lineEnd > line && lineEnd[-1] == '\r')
+				{
+					lineEnd--;
+				}
 
-					if (*e != delimiter) break;
-					b = e + 1;
+				if (lineEnd > line) // avoid the empty line
+				{
+					rowStarts.push_back(tokens.size());
+
+					// loop over columns
+					const char* b = line;
+					for (;;)
+					{
+						const char* e = static_cast<const char*>(memchr(b, delimiter, lineEnd - b));
+						if (!e)
+						{
+							tokens.emplace_back(b, lineEnd - b);
+							break;
+						}
+
+						tokens.emplace_back(b, e - b);
+						b = e + 1;
+					}
 				}
 
-				rows.emplace_back(row);
+				line = nextLine;
 			}
 		}
 	};
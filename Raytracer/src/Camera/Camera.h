@@ -3,7 +3,7 @@
 
 #include<cmath>
 
-#include "glm/vec3.hpp"
+#include "glm/glm.hpp"
 
 #include "../Geom3D/Geom3D.h"
 
@@ -67,7 +67,7 @@ public:
   // get ray
   Geom3D::Ray GetRay(float u, float v)
   {
-		glm::vec3 target = nearPlaneBottomLeft + nearPlaneHorizontal * u + nearPlaneVertical * v - position;
+		glm::vec3 target = nearPlaneBottomLeft + nearPlaneHorizontal * u + nearPlaneVertical * v;
     return Geom3D::Ray(position, target - position);
   }
 
@@ -2,6 +2,12 @@
 #define ABBB_H
 
 #include <algorithm>
+#include <cfloat>
+
+#include "glm/glm.hpp"
+
+#include "Ray.h"
+#include "RayPacket.h"
 
 namespace Geom3D
 {
@@ -11,7 +17,11 @@ namespace Geom3D
     glm::vec3 max;
 
   public:
-    AABB(){};
+    AABB()
+      : min(glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX))
+      , max(glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX))
+    {
+    };
     AABB(const glm::vec3& min_, const glm::vec3& max_)
       : min(min_)
       , max(max_)
@@ -25,54 +35,73 @@ namespace Geom3D
     const glm::vec3& Min() const { return min; }
     const glm::vec3& Max() const { return max; }
 
+    // grow to contain other AABB
+    void Grow(const AABB& other)
+    {
+      min = glm::min(min, other.min);
+      max = glm::max(max, other.max);
+    }
+
+    // center
+    glm::vec3 Center() const { return (min + max) * 0.5f; }
+
+    // surface area
+    float SurfaceArea() const
+    {
+      glm::vec3 extent = max - min;
+      return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+    }
+
     // Intersect
+    // Branch free slab test: t of the ray entering and leaving the slabs of every axis using the precomputed inverse
+    // direction, then the latest entry and the earliest exit
     bool Intersect(const Ray& ray, float& tMin, float& tMax) const
     {
-      // calculate minimum and maximum t on axis X
-      float txMin = (min.x - ray.Origin().x) / ray.Direction().x;
-      float txMax = (max.x - ray.Origin().x) / ray.Direction().x;
-      if (txMin > txMax)
-      {
-        std::swap(txMin, txMax);
-      }
+      glm::vec3 t0 = (min - ray.Origin()) * ray.InverseDirection();
+      glm::vec3 t1 = (max - ray.Origin()) * ray.InverseDirection();
 
-      // calculate minimum and maximum t on Axis Y
-      float tyMin = (min.y - ray.Origin().y) / ray.Direction().y;
-      float tyMax = (max.y - ray.Origin().y) / ray.Direction().y;
-      if (tyMin > tyMax)
-      {
-        std::swap(tyMin, tyMax);
-      }
+      glm::vec3 tNear = glm::min(t0, t1);
+      glm::vec3 tFar = glm::max(t0, t1);
 
-      if ((txMin > tyMax) || (tyMin > txMax))
-      {
-        // intersection outside the box
-        return false;
-      }
-        
-      // calculate minimum and maximum t on XY
-      tMin = std::max(txMin, tyMin);
-      tMax = std::min(txMax, tyMax);
-
-      // calculate minimum and maximum t on Axis Z
-      float tzMin = (min.z - ray.Origin().z) / ray.Direction().z;
-      float tzMax = (max.z - ray.Origin().z) / ray.Direction().z;
-      if (tzMin > tzMax)
-      {
-        std::swap(tzMin, tzMax);
-      }
+      tMin = std::max(std::max(tNear.x, tNear.y), tNear.z);
+      tMax = std::min(std::min(tFar.x, tFar.y), tFar.z);
+
+      return tMin <= tMax;
+    }
+
+    // Intersect a packet of rays, each one limited to its own max distance
+    // Returns true if any of the rays hits the box
+    bool Intersect(const RayPacket& packet, float minDistance, const float* maxDistances) const
+    {
+      SIMD::Float minX(min.x), minY(min.y), minZ(min.z);
+      SIMD::Float maxX(max.x), maxY(max.y), maxZ(max.z);
 
-      if ((tMin > tzMax) || (tzMin > tMax))
+      for (int lane = 0; lane < RayPacket::SIZE; lane += SIMD::Float::LANES)
       {
-        // intersection outside the box
-        return false;
+        SIMD::Float originX = SIMD::Float::Load(&packet.originX[lane]);
+        SIMD::Float originY = SIMD::Float::Load(&packet.originY[lane]);
+        SIMD::Float originZ = SIMD::Float::Load(&packet.originZ[lane]);
+        SIMD::Float inverseDirectionX = SIMD::Float::Load(&packet.inverseDirectionX[lane]);
+        SIMD::Float inverseDirectionY = SIMD::Float::Load(&packet.inverseDirectionY[lane]);
+        SIMD::Float inverseDirectionZ = SIMD::Float::Load(&packet.inverseDirectionZ[lane]);
+
+        SIMD::Float t0X = (minX - originX) * inverseDirectionX;
+        SIMD::Float t1X = (maxX - originX) * inverseDirectionX;
+        SIMD::Float t0Y = (minY - originY) * inverseDirectionY;
+        SIMD::Float t1Y = (maxY - originY) * inverseDirectionY;
+        SIMD::Float t0Z = (minZ - originZ) * inverseDirectionZ;
+        SIMD::Float t1Z = (maxZ - originZ) * inverseDirectionZ;
+
+        SIMD::Float tNear = SIMD::Max(SIMD::Max(SIMD::Float(minDistance), SIMD::Min(t0X, t1X)), SIMD::Max(SIMD::Min(t0Y, t1Y), SIMD::Min(t0Z, t1Z)));
+        SIMD::Float tFar = SIMD::Min(SIMD::Min(SIMD::Float::Load(&maxDistances[lane]), SIMD::Max(t0X, t1X)), SIMD::Min(SIMD::Max(t0Y, t1Y), SIMD::Max(t0Z, t1Z)));
+
+        if (SIMD::MoveMask(tNear <= tFar) != 0)
+        {
+          return true;
+        }
       }
-        
-      // calculate minimum and maximum t on XYZ
-      tMin = std::max(tMin, tzMin);
-      tMax = std::min(tMax, tzMax);
 
-      return true;
+      return false;
     }
 
   };
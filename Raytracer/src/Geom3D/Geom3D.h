@@ -2,6 +2,7 @@
 #define GEOM_3D_H
 
 #include "Ray.h"
+#include "RayPacket.h"
 #include "AABB.h"
 #include "Shapes/Shapes.h"
 #include "Shapes/ShapeFactory.h"
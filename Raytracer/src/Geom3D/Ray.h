@@ -1,6 +1,9 @@
 #ifndef RAY_H
 #define RAY_H
 
+#include <cfloat>
+#include <cmath>
+
 #include "glm/vec3.hpp"
 
 namespace Geom3D
@@ -10,6 +13,10 @@ namespace Geom3D
 		glm::vec3 o;
 		glm::vec3 d;
 
+		// precomputed for the slab tests: inverse direction and whether each direction component is negative
+		glm::vec3 invD;
+		int sign[3];
+
 	public:
 
 		// constructors
@@ -18,25 +25,48 @@ namespace Geom3D
 			, d(glm::vec3(1.0f, 0.0f, 0.0f))
 
 		{
+			CalculateInverseDirection();
 		}
 
 		Ray(const glm::vec3& origin, const glm::vec3& direction)
 			: o(origin)
 			, d(direction)
 		{
+			CalculateInverseDirection();
 		}
 
 		// setter and getters
+		// Note: the direction has no mutable getter so the inverse direction never goes stale
 		glm::vec3& Origin() { return o; }
-		glm::vec3& Direction() { return d; }
 
 		const glm::vec3& Origin() const { return o; }
 		const glm::vec3& Direction() const { return d; }
+		const glm::vec3& InverseDirection() const { return invD; }
+		const int* Sign() const { return sign; }
+
+		void SetDirection(const glm::vec3& direction)
+		{
+			d = direction;
+			CalculateInverseDirection();
+		}
 
 		// point at t
 		glm::vec3 PointAtT(float t) const { return o + t*d; }
+
+	private:
+
+		// calculate inverse direction and sign bits
+		void CalculateInverseDirection()
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				// zero components get a huge finite inverse instead of infinity, so the slab test never computes 0 * inf = NaN
+				// when the origin lies on a slab plane
+				invD[axis] = d[axis] != 0.0f ? 1.0f / d[axis] : (std::signbit(d[axis]) ? -FLT_MAX : FLT_MAX);
+				sign[axis] = invD[axis] < 0.0f ? 1 : 0;
+			}
+		}
 	};
 }
 
 #endif // !RAY_H
-
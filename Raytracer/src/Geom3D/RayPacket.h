@@ -0,0 +1,58 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "Ray.h"
+#include "../SIMD/SIMD.h"
+
+namespace Geom3D
+{
+	// Packet of coherent rays stored in SoA form so every node and primitive fetched is tested against all of them
+	// Unused lanes repeat the last ray added, so they follow the same traversal and their results are just ignored
+	struct RayPacket
+	{
+		static const int SIZE = 8;
+
+		// rays as added
+		Ray rays[SIZE];
+
+		// SoA copies of origins, directions and inverse directions
+		alignas(32) float originX[SIZE];
+		alignas(32) float originY[SIZE];
+		alignas(32) float originZ[SIZE];
+		alignas(32) float directionX[SIZE];
+		alignas(32) float directionY[SIZE];
+		alignas(32) float directionZ[SIZE];
+		alignas(32) float inverseDirectionX[SIZE];
+		alignas(32) float inverseDirectionY[SIZE];
+		alignas(32) float inverseDirectionZ[SIZE];
+
+		// number of rays
+		int count = 0;
+
+		// clear
+		void Clear() { count = 0; }
+
+		// add a ray
+		void Add(const Ray& ray)
+		{
+			rays[count] = ray;
+			for (int lane = count; lane < SIZE; lane++)
+			{
+				originX[lane] = ray.Origin().x;
+				originY[lane] = ray.Origin().y;
+				originZ[lane] = ray.Origin().z;
+				directionX[lane] = ray.Direction().x;
+				directionY[lane] = ray.Direction().y;
+				directionZ[lane] = ray.Direction().z;
+				inverseDirectionX[lane] = ray.InverseDirection().x;
+				inverseDirectionY[lane] = ray.InverseDirection().y;
+				inverseDirectionZ[lane] = ray.InverseDirection().z;
+			}
+			count++;
+		}
+
+		bool IsFull() const { return count == SIZE; }
+	};
+}
+
+#endif // !RAY_PACKET_H
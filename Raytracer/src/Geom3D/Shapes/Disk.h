@@ -0,0 +1,53 @@
+#ifndef DISK_H
+#define DISK_H
+
+#include "Plane.h"
+
+namespace Geom3D
+{
+	// Disk: the part of a plane within a radius of its center
+	class Disk : public Plane
+	{
+    // radius
+		float radius;
+
+	public:
+
+    // constructors
+		Disk(const glm::vec3& center_, const glm::vec3& normal_, float radius_, MaterialId materialId_)
+			: Plane(ShapeType::DISK, center_, normal_, materialId_)
+			, radius(radius_)
+		{
+			CalculateAABB();
+		}
+
+		// getters
+		const glm::vec3& Center() const { return point; }
+		float Radius() const { return radius; }
+
+    // calculate AABB. Along every axis the disk extends radius * sqrt(1 - normal^2)
+    void CalculateAABB()
+    {
+      glm::vec3 extent = radius * glm::sqrt(glm::max(glm::vec3(1.0f) - normal * normal, glm::vec3(0.0f)));
+
+      aabb.Min() = point - extent;
+      aabb.Max() = point + extent;
+    }
+
+    bool IsBounded() const { return true; }
+
+		// Intersect
+		bool Intersect(const Ray& ray, float minDistance, float maxDistance, float& t) const
+		{
+			if (!IntersectPlane(ray, minDistance, maxDistance, t))
+			{
+				return false;
+			}
+
+			glm::vec3 offset = ray.PointAtT(t) - point;
+			return glm::dot(offset, offset) <= radius * radius;
+		}
+	};
+}
+
+#endif // !DISK_H
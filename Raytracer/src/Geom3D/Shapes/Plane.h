@@ -0,0 +1,85 @@
+#ifndef PLANE_H
+#define PLANE_H
+
+#include "Shape.h"
+
+#include "glm/glm.hpp"
+
+namespace Geom3D
+{
+	// Infinite plane through a point
+	class Plane : public Shape
+	{
+	protected:
+
+    // point on the plane and unit normal
+		glm::vec3 point;
+		glm::vec3 normal;
+
+    // attached material
+    MaterialId materialId = NO_MATERIAL;
+
+	public:
+
+    // constructors
+		Plane(const glm::vec3& point_, const glm::vec3& normal_, MaterialId materialId_)
+			: Plane(ShapeType::PLANE, point_, normal_, materialId_)
+		{
+		}
+
+		// getters
+		const glm::vec3& Point() const { return point; }
+		const glm::vec3& Normal() const { return normal; }
+		MaterialId GetMaterialId() const { return materialId; }
+
+    // a plane has no bounds, its AABB stays empty
+    void CalculateAABB()
+    {
+      aabb = AABB();
+    }
+
+    bool IsBounded() const { return false; }
+
+		// Intersect
+		bool Intersect(const Ray& ray, float minDistance, float maxDistance, float& t) const
+		{
+			return IntersectPlane(ray, minDistance, maxDistance, t);
+		}
+
+		// set hit. Planes are two sided so the normal faces the ray
+		void SetHit(const Ray& ray, float t, RaycastHit& raycastHit) const
+		{
+			raycastHit.hitDistance = t;
+			raycastHit.hitPos = ray.PointAtT(t);
+			raycastHit.hitNormal = glm::dot(normal, ray.Direction()) < 0.0f ? normal : -normal;
+			raycastHit.hitMaterialId = materialId;
+		}
+
+	protected:
+
+		Plane(ShapeType type_, const glm::vec3& point_, const glm::vec3& normal_, MaterialId materialId_)
+			: Shape(type_)
+			, point(point_)
+			, normal(glm::normalize(normal_))
+			, materialId(materialId_)
+		{
+			CalculateAABB();
+		}
+
+		// distance to the plane along the ray if it is within [minDistance, maxDistance]
+		bool IntersectPlane(const Ray& ray, float minDistance, float maxDistance, float& t) const
+		{
+			float denominator = glm::dot(normal, ray.Direction());
+			if (denominator == 0.0f)
+			{
+				// parallel to the plane
+				return false;
+			}
+
+			t = glm::dot(point - ray.Origin(), normal) / denominator;
+			return t >= minDistance && t <= maxDistance;
+		}
+	};
+}
+
+#endif // !PLANE_H
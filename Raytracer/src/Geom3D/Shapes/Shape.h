@@ -1,47 +1,68 @@
 #ifndef SHAPE_H
 #define SHAPE_H
 
+#include <cfloat>
+
 #include "glm/vec3.hpp"
 
 #include "../Ray.h"
 #include "../AABB.h"
-
-class Material;
+#include "../../Materials/MaterialId.h"
 
 namespace Geom3D
 {
+  // surface interaction at the closest hit of a ray
   struct RaycastHit
   {
-    Ray ray;
-		
 		float hitDistance = FLT_MAX;
     glm::vec3 hitPos;
     glm::vec3 hitNormal;
 
-    const Material* hitMaterial = nullptr;
+    MaterialId hitMaterialId = NO_MATERIAL;
+  };
+
+  // shape types
+  enum class ShapeType
+  {
+    SPHERE,
+    PLANE,
+    DISK,
+
+    COUNT
   };
 
+	// Data common to every shape type
+	// Shapes are plain values stored in one array per type (see ShapeArrays) and dispatched on their type, so
+	// there are no virtual functions. Every shape type provides:
+	// - CalculateAABB()
+	// - IsBounded(): whether the shape fits in its AABB. Unbounded shapes can not go in a BVH
+	// - Intersect(ray, minDistance, maxDistance, t): distance to the nearest intersection within [minDistance, maxDistance].
+	//   Only the distance is computed so rejecting candidates that a closer hit later discards stays cheap
+	// - SetHit(ray, t, raycastHit): fill the surface interaction of the ray hitting the shape at distance t
 	class Shape
 	{
   protected:
 
+    // type
+    ShapeType type;
+
     // AABB
     AABB aabb;
 
-	public:
+    Shape(ShapeType type_)
+      : type(type_)
+    {
+    }
 
-		virtual ~Shape() {};
+	public:
 
     // getters 
+    ShapeType Type() const { return type; }
     const AABB& GetAABB() const { return aabb; }
 
-    // Calculate AABB
-    virtual void CalculateAABB() = 0;
-
-    // Raycast
-		virtual bool Raycast(const Ray& ray, float minDistance, float maxDistance, RaycastHit& raycastHit) = 0;
-
+    // bounded by default
+    bool IsBounded() const { return true; }
 	};
 }
 
-#endif SHAPE_H
+#endif // !SHAPE_H
@@ -0,0 +1,183 @@
+#ifndef SHAPE_ARRAYS_H
+#define SHAPE_ARRAYS_H
+
+#include <cstdint>
+#include <vector>
+
+#include "Sphere.h"
+#include "Plane.h"
+#include "Disk.h"
+#include "../../Memory/SceneAllocator.h"
+#include "../../Snapshot/Snapshot.h"
+
+namespace Geom3D
+{
+  // reference to a shape in ShapeArrays: its type and its index in the array of that type
+  struct ShapeRef
+  {
+    ShapeType type;
+    uint32_t index;
+  };
+
+  // Shapes stored by value in one contiguous array per type
+  // Functions taking a ShapeRef switch on its type and call the function of the concrete shape
+  class ShapeArrays
+  {
+    // shapes by type
+    SceneVector<Sphere> spheres;
+    SceneVector<Plane> planes;
+    SceneVector<Disk> disks;
+
+    // every shape in the order they were added
+    SceneVector<ShapeRef> shapes;
+
+  public:
+
+    // add shape
+    ShapeRef Add(const Sphere& sphere) { return Add(spheres, sphere); }
+    ShapeRef Add(const Plane& plane) { return Add(planes, plane); }
+    ShapeRef Add(const Disk& disk) { return Add(disks, disk); }
+
+    // add count default spheres and return them, so they can be set in place
+    Sphere* AddSpheres(uint32_t count)
+    {
+      uint32_t first = (uint32_t)spheres.size();
+      spheres.resize(first + count);
+
+      shapes.reserve(shapes.size() + count);
+      for (uint32_t i = 0; i < count; i++)
+      {
+        shapes.push_back({ ShapeType::SPHERE, first + i });
+      }
+
+      return spheres.data() + first;
+    }
+
+    // clear
+    void Clear()
+    {
+      spheres.clear();
+      planes.clear();
+      disks.clear();
+      shapes.clear();
+    }
+
+    // save/load to/from a snapshot
+    void Save(Snapshot::Writer& writer) const
+    {
+      writer.WriteArray(spheres);
+      writer.WriteArray(planes);
+      writer.WriteArray(disks);
+      writer.WriteArray(shapes);
+    }
+
+    bool Load(Snapshot::Reader& reader)
+    {
+      return reader.ReadArray(spheres) && reader.ReadArray(planes) && reader.ReadArray(disks) && reader.ReadArray(shapes);
+    }
+
+    // whether every shape reference and material id is in bounds, to check loaded snapshots
+    bool IsValid(uint32_t materialsCount) const
+    {
+      for (const Sphere& sphere : spheres)
+      {
+        if (sphere.GetMaterialId() >= materialsCount)
+        {
+          return false;
+        }
+      }
+
+      for (const Plane& plane : planes)
+      {
+        if (plane.GetMaterialId() >= materialsCount)
+        {
+          return false;
+        }
+      }
+
+      for (const Disk& disk : disks)
+      {
+        if (disk.GetMaterialId() >= materialsCount)
+        {
+          return false;
+        }
+      }
+
+      for (ShapeRef shape : shapes)
+      {
+        if (!IsValid(shape))
+        {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    // whether the reference points to a shape in the arrays
+    bool IsValid(ShapeRef ref) const
+    {
+      switch (ref.type)
+      {
+      case ShapeType::SPHERE: return ref.index < spheres.size();
+      case ShapeType::PLANE: return ref.index < planes.size();
+      case ShapeType::DISK: return ref.index < disks.size();
+      default: return false;
+      }
+    }
+
+    // getters
+    uint32_t Size() const { return (uint32_t)shapes.size(); }
+    const SceneVector<ShapeRef>& Shapes() const { return shapes; }
+    const SceneVector<Sphere>& Spheres() const { return spheres; }
+    const SceneVector<Plane>& Planes() const { return planes; }
+    const SceneVector<Disk>& Disks() const { return disks; }
+
+    // shape functions
+    const AABB& GetAABB(ShapeRef ref) const
+    {
+      return Visit(ref, [](const auto& shape) -> const AABB& { return shape.GetAABB(); });
+    }
+
+    bool IsBounded(ShapeRef ref) const
+    {
+      return Visit(ref, [](const auto& shape) { return shape.IsBounded(); });
+    }
+
+    bool Intersect(ShapeRef ref, const Ray& ray, float minDistance, float maxDistance, float& t) const
+    {
+      return Visit(ref, [&](const auto& shape) { return shape.Intersect(ray, minDistance, maxDistance, t); });
+    }
+
+    void SetHit(ShapeRef ref, const Ray& ray, float t, RaycastHit& raycastHit) const
+    {
+      Visit(ref, [&](const auto& shape) { shape.SetHit(ray, t, raycastHit); });
+    }
+
+  private:
+
+    // add a shape to the array of its type
+    template<typename ShapeT>
+    ShapeRef Add(SceneVector<ShapeT>& array, const ShapeT& shape)
+    {
+      ShapeRef ref = { shape.Type(), (uint32_t)array.size() };
+      array.push_back(shape);
+      shapes.push_back(ref);
+      return ref;
+    }
+
+    // call a function with the concrete shape
+    template<typename Function>
+    auto Visit(ShapeRef ref, Function&& function) const -> decltype(function(spheres[0]))
+    {
+      switch (ref.type)
+      {
+      case ShapeType::SPHERE: return function(spheres[ref.index]);
+      case ShapeType::PLANE: return function(planes[ref.index]);
+      default: return function(disks[ref.index]);
+      }
+    }
+  };
+}
+
+#endif // !SHAPE_ARRAYS_H
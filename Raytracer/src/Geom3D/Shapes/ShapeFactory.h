@@ -1,16 +1,20 @@
 #ifndef SHAPE_FACTORY_H
 #define SHAPE_FACTORY_H
 
+#include <cassert>
+#include <string>
+
 #include "Shapes.h"
 
 namespace Geom3D
 {
   struct ShapeFactoryParams
   {
-    std::shared_ptr<Material> material = nullptr;
+    MaterialId materialId = NO_MATERIAL;
 
     std::string shapeType;
     glm::vec3 shapePos;
+    glm::vec3 normal = glm::vec3(0.0f, 1.0f, 0.0f);
     float radius = 0.5f;
   };
 
@@ -18,16 +22,20 @@ namespace Geom3D
   {
   public:
     
-    static std::shared_ptr<Shape> Create(const ShapeFactoryParams& params)
+    // create a shape in the array of its type
+    static ShapeRef Create(const ShapeFactoryParams& params, ShapeArrays& shapes)
     {
-      std::shared_ptr<Shape> shape;
-      if (params.shapeType == "Sphere")
+      if (params.shapeType == "Plane")
+      {
+        return shapes.Add(Geom3D::Plane(params.shapePos, params.normal, params.materialId));
+      }
+      else if (params.shapeType == "Disk")
       {
-        shape = std::make_shared<Geom3D::Sphere>(params.shapePos, params.radius, params.material);
+        return shapes.Add(Geom3D::Disk(params.shapePos, params.normal, params.radius, params.materialId));
       }
 
-      assert(shape);
-      return shape;
+      assert(params.shapeType == "Sphere");
+      return shapes.Add(Geom3D::Sphere(params.shapePos, params.radius, params.materialId));
     }
 
   private:
@@ -3,5 +3,8 @@
 
 #include "Shapes.h"
 #include "Sphere.h"
+#include "Plane.h"
+#include "Disk.h"
+#include "ShapeArrays.h"
 
 #endif // !SHAPES_H
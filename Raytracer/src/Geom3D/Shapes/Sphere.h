@@ -3,9 +3,7 @@
 
 #include "Shape.h"
 
-#include <memory>
-
-class Material;
+#include "glm/glm.hpp"
 
 namespace Geom3D
 {
@@ -16,29 +14,32 @@ namespace Geom3D
 		float radius;
 
     // attached material
-    std::shared_ptr<Material> material;
+    MaterialId materialId = NO_MATERIAL;
 
 	public:
 
     // constructors
 		Sphere() 
-		: center(glm::vec3(0.0f, 0.0f, 0.0f))
+		: Shape(ShapeType::SPHERE)
+		, center(glm::vec3(0.0f, 0.0f, 0.0f))
 		, radius(1.0f)
 		{
       CalculateAABB();
 		};
 
 		Sphere(const glm::vec3& center_, float radius_)
-			: center(center_)
+			: Shape(ShapeType::SPHERE)
+			, center(center_)
 			, radius(radius_)
 		{
       CalculateAABB();
 		};
 
-    Sphere(const glm::vec3& center_, float radius_, const std::shared_ptr<Material>& material_)
-      : center(center_)
+    Sphere(const glm::vec3& center_, float radius_, MaterialId materialId_)
+      : Shape(ShapeType::SPHERE)
+      , center(center_)
       , radius(radius_)
-      , material(material_)
+      , materialId(materialId_)
     {
       CalculateAABB();
     };
@@ -50,7 +51,7 @@ namespace Geom3D
 		glm::vec3& Center() { return center; }
 		float& Radius() { return radius; }
 
-		const std::shared_ptr<Material>& GetMaterial() const { return material; }
+		MaterialId GetMaterialId() const { return materialId; }
 
     // calculate AABB
     void CalculateAABB()
@@ -61,8 +62,8 @@ namespace Geom3D
       aabb.Max() = center + p;
     }
 
-		// Raycast
-		bool Raycast(const Ray& ray, float minDistance, float maxDistance, RaycastHit& raycastHit) override
+		// Intersect
+		bool Intersect(const Ray& ray, float minDistance, float maxDistance, float& t) const
 		{
 			glm::vec3 cc = ray.Origin() - center;
 			float a = glm::dot(ray.Direction(), ray.Direction());
@@ -76,22 +77,23 @@ namespace Geom3D
 				float t1 = (-b - discriminantSq) / a;
 				float t2 = (-b + discriminantSq) / a;
 
-				float t = std::min(t1, t2);
-
-				if (t >= minDistance && t <= maxDistance)
-				{
-					raycastHit.hitDistance = t;
-					raycastHit.hitPos = ray.PointAtT(t);
-					raycastHit.hitNormal = glm::normalize(raycastHit.hitPos - center);
-					raycastHit.hitMaterial = material.get();
+				t = std::min(t1, t2);
 
-					return true;
-				}
+				return t >= minDistance && t <= maxDistance;
 			}
 
 			return false;
 		}
 
+		// set hit
+		void SetHit(const Ray& ray, float t, RaycastHit& raycastHit) const
+		{
+			raycastHit.hitDistance = t;
+			raycastHit.hitPos = ray.PointAtT(t);
+			raycastHit.hitNormal = glm::normalize(raycastHit.hitPos - center);
+			raycastHit.hitMaterialId = materialId;
+		}
+
 	};
 }
 
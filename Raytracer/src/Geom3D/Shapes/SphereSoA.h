@@ -0,0 +1,439 @@
+#ifndef SPHERE_SOA_H
+#define SPHERE_SOA_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "ShapeArrays.h"
+#include "../../SIMD/SIMD.h"
+#include "../../Memory/SceneAllocator.h"
+#include "../../Snapshot/Snapshot.h"
+#include "../RayPacket.h"
+
+namespace Geom3D
+{
+	// Shapes packed in SoA form so one ray is tested against 4 (SSE) or 8 (AVX) spheres at once
+	// Other shape types keep their slot, so indices match the source shapes, and are tested one by one
+	class SphereSoA
+	{
+		// sphere data
+		SceneVector<float> centerX;
+		SceneVector<float> centerY;
+		SceneVector<float> centerZ;
+		SceneVector<float> radiusSquared;
+		SceneVector<MaterialId> materials;
+
+		// source shapes
+		const ShapeArrays* shapeArrays = nullptr;
+		SceneVector<ShapeRef> shapes;
+
+		// whether any shape is not a sphere
+		bool hasOtherShapes = false;
+
+		// the arrays are padded so SIMD loads past the last shape stay in bounds
+		static const uint32_t PADDING = 8;
+
+	public:
+
+		// build from a list of shapes
+		void Build(const ShapeArrays& sourceShapeArrays, const SceneVector<ShapeRef>& sourceShapes)
+		{
+			Clear();
+
+			Reserve((uint32_t)sourceShapes.size());
+			for (ShapeRef shape : sourceShapes)
+			{
+				Add(sourceShapeArrays, shape);
+			}
+		}
+
+		// add a shape
+		// Note: all the shapes must come from the same shape arrays
+		void Add(const ShapeArrays& sourceShapeArrays, ShapeRef shape)
+		{
+			shapeArrays = &sourceShapeArrays;
+
+			uint32_t index = Size();
+			Resize(index + 1);
+
+			if (shape.type == ShapeType::SPHERE)
+			{
+				SetSphere(index, shape.index);
+			}
+			else
+			{
+				shapes[index] = shape;
+				hasOtherShapes = true;
+			}
+		}
+
+		// Add count slots for spheres and return the first one
+		// The slots have to be set with SetSphere, which can be called in parallel for different slots
+		uint32_t AddSphereSlots(const ShapeArrays& sourceShapeArrays, uint32_t count)
+		{
+			shapeArrays = &sourceShapeArrays;
+
+			uint32_t first = Size();
+			Resize(first + count);
+			return first;
+		}
+
+		// set a slot to a sphere
+		void SetSphere(uint32_t index, uint32_t sphereIndex)
+		{
+			const Sphere& sphere = shapeArrays->Spheres()[sphereIndex];
+			shapes[index] = { ShapeType::SPHERE, sphereIndex };
+			centerX[index] = sphere.Center().x;
+			centerY[index] = sphere.Center().y;
+			centerZ[index] = sphere.Center().z;
+			radiusSquared[index] = sphere.Radius() * sphere.Radius();
+			materials[index] = sphere.GetMaterialId();
+		}
+
+		// clear
+		void Clear()
+		{
+			centerX.clear();
+			centerY.clear();
+			centerZ.clear();
+			radiusSquared.clear();
+			materials.clear();
+			shapeArrays = nullptr;
+			shapes.clear();
+			hasOtherShapes = false;
+		}
+
+		// number of shapes
+		uint32_t Size() const { return (uint32_t)shapes.size(); }
+
+		// save/load to/from a snapshot. The source shapes must be loaded first
+		void Save(Snapshot::Writer& writer) const
+		{
+			writer.WriteArray(centerX);
+			writer.WriteArray(centerY);
+			writer.WriteArray(centerZ);
+			writer.WriteArray(radiusSquared);
+			writer.WriteArray(materials);
+			writer.WriteArray(shapes);
+			writer.Write(hasOtherShapes);
+		}
+
+		bool Load(Snapshot::Reader& reader, const ShapeArrays& sourceShapeArrays)
+		{
+			shapeArrays = &sourceShapeArrays;
+			return reader.ReadArray(centerX) && reader.ReadArray(centerY) && reader.ReadArray(centerZ) && reader.ReadArray(radiusSquared)
+				&& reader.ReadArray(materials) && reader.ReadArray(shapes) && reader.Read(hasOtherShapes);
+		}
+
+		// whether the arrays are padded and every shape and material is in bounds, to check loaded snapshots
+		bool IsValid(uint32_t materialsCount) const
+		{
+			// arrays never resized are left empty
+			uint32_t count = Size();
+			if (count == 0 && centerX.empty() && centerY.empty() && centerZ.empty() && radiusSquared.empty() && materials.empty())
+			{
+				return true;
+			}
+
+			if (centerX.size() != count + PADDING || centerY.size() != count + PADDING || centerZ.size() != count + PADDING
+				|| radiusSquared.size() != count + PADDING || materials.size() != count)
+			{
+				return false;
+			}
+
+			for (uint32_t i = 0; i < count; i++)
+			{
+				if (!shapeArrays->IsValid(shapes[i]) || (shapes[i].type == ShapeType::SPHERE && materials[i] >= materialsCount))
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		// Intersect the shapes in [begin, end) against the closest hit found so far
+		// Only finds the closest shape: maxDistance shrinks to its distance and closest is set to its index. Call SetHit
+		// once the search is done to get the surface interaction of the winner
+		bool Intersect(const Ray& ray, uint32_t begin, uint32_t end, float minDistance, float& maxDistance, int& closest) const
+		{
+			const glm::vec3& origin = ray.Origin();
+			const glm::vec3& direction = ray.Direction();
+			float a = glm::dot(direction, direction);
+
+			bool hit = false;
+			uint32_t i = begin;
+
+#if SIMD_AVX
+			if (end - begin > 4)
+			{
+				__m256 originX = _mm256_set1_ps(origin.x);
+				__m256 originY = _mm256_set1_ps(origin.y);
+				__m256 originZ = _mm256_set1_ps(origin.z);
+				__m256 directionX = _mm256_set1_ps(direction.x);
+				__m256 directionY = _mm256_set1_ps(direction.y);
+				__m256 directionZ = _mm256_set1_ps(direction.z);
+				__m256 aV = _mm256_set1_ps(a);
+				__m256 minDistanceV = _mm256_set1_ps(minDistance);
+
+				for (; i < end; i += 8)
+				{
+					__m256 ccX = _mm256_sub_ps(originX, _mm256_loadu_ps(&centerX[i]));
+					__m256 ccY = _mm256_sub_ps(originY, _mm256_loadu_ps(&centerY[i]));
+					__m256 ccZ = _mm256_sub_ps(originZ, _mm256_loadu_ps(&centerZ[i]));
+
+					__m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ccX, directionX), _mm256_mul_ps(ccY, directionY)), _mm256_mul_ps(ccZ, directionZ));
+					__m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ccX, ccX), _mm256_mul_ps(ccY, ccY)), _mm256_mul_ps(ccZ, ccZ)), _mm256_loadu_ps(&radiusSquared[i]));
+					__m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(aV, c));
+
+					// nearest root: (-b - sqrt(discriminant)) / a
+					__m256 t = _mm256_div_ps(_mm256_sub_ps(_mm256_setzero_ps(), _mm256_add_ps(b, _mm256_sqrt_ps(discriminant))), aV);
+
+					__m256 valid = _mm256_and_ps(_mm256_cmp_ps(discriminant, _mm256_setzero_ps(), _CMP_GT_OQ),
+						_mm256_and_ps(_mm256_cmp_ps(t, minDistanceV, _CMP_GE_OQ), _mm256_cmp_ps(t, _mm256_set1_ps(maxDistance), _CMP_LE_OQ)));
+
+					int mask = _mm256_movemask_ps(valid) & LaneMask(end - i);
+					if (mask != 0)
+					{
+						alignas(32) float distances[8];
+						_mm256_store_ps(distances, t);
+						hit = SelectClosest(mask, distances, i, maxDistance, closest) || hit;
+					}
+				}
+			}
+#endif
+
+#if SIMD_SSE
+			if (i < end)
+			{
+				__m128 originX = _mm_set1_ps(origin.x);
+				__m128 originY = _mm_set1_ps(origin.y);
+				__m128 originZ = _mm_set1_ps(origin.z);
+				__m128 directionX = _mm_set1_ps(direction.x);
+				__m128 directionY = _mm_set1_ps(direction.y);
+				__m128 directionZ = _mm_set1_ps(direction.z);
+				__m128 aV = _mm_set1_ps(a);
+				__m128 minDistanceV = _mm_set1_ps(minDistance);
+
+				for (; i < end; i += 4)
+				{
+					__m128 ccX = _mm_sub_ps(originX, _mm_loadu_ps(&centerX[i]));
+					__m128 ccY = _mm_sub_ps(originY, _mm_loadu_ps(&centerY[i]));
+					__m128 ccZ = _mm_sub_ps(originZ, _mm_loadu_ps(&centerZ[i]));
+
+					__m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ccX, directionX), _mm_mul_ps(ccY, directionY)), _mm_mul_ps(ccZ, directionZ));
+					__m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ccX, ccX), _mm_mul_ps(ccY, ccY)), _mm_mul_ps(ccZ, ccZ)), _mm_loadu_ps(&radiusSquared[i]));
+					__m128 discriminant = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(aV, c));
+
+					// nearest root: (-b - sqrt(discriminant)) / a
+					__m128 t = _mm_div_ps(_mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(b, _mm_sqrt_ps(discriminant))), aV);
+
+					__m128 valid = _mm_and_ps(_mm_cmpgt_ps(discriminant, _mm_setzero_ps()),
+						_mm_and_ps(_mm_cmpge_ps(t, minDistanceV), _mm_cmple_ps(t, _mm_set1_ps(maxDistance))));
+
+					int mask = _mm_movemask_ps(valid) & LaneMask(end - i);
+					if (mask != 0)
+					{
+						alignas(16) float distances[4];
+						_mm_store_ps(distances, t);
+						hit = SelectClosest(mask, distances, i, maxDistance, closest) || hit;
+					}
+				}
+			}
+#endif
+
+			// scalar fallback
+			for (; i < end; i++)
+			{
+				float ccX = origin.x - centerX[i];
+				float ccY = origin.y - centerY[i];
+				float ccZ = origin.z - centerZ[i];
+
+				float b = ccX * direction.x + ccY * direction.y + ccZ * direction.z;
+				float c = ccX * ccX + ccY * ccY + ccZ * ccZ - radiusSquared[i];
+				float discriminant = b * b - a * c;
+				if (discriminant > 0.0f)
+				{
+					float t = -(b + sqrtf(discriminant)) / a;
+					if (t >= minDistance && t <= maxDistance)
+					{
+						maxDistance = t;
+						closest = (int)i;
+						hit = true;
+					}
+				}
+			}
+
+			if (hasOtherShapes)
+			{
+				for (uint32_t j = begin; j < end; j++)
+				{
+					float t = 0.0f;
+					if (shapes[j].type != ShapeType::SPHERE && shapeArrays->Intersect(shapes[j], ray, minDistance, maxDistance, t))
+					{
+						maxDistance = t;
+						closest = (int)j;
+						hit = true;
+					}
+				}
+			}
+
+			return hit;
+		}
+
+		// Intersect the shapes in [begin, end) with every ray of a packet
+		// Each ray keeps its own max distance and the index of its closest shape. Call SetHit once the traversal is
+		// done to get the surface interactions
+		void IntersectPacket(const RayPacket& packet, uint32_t begin, uint32_t end, float minDistance, float* maxDistances, int* closest) const
+		{
+			const int GROUPS = RayPacket::SIZE / SIMD::Float::LANES;
+
+			SIMD::Float originX[GROUPS], originY[GROUPS], originZ[GROUPS];
+			SIMD::Float directionX[GROUPS], directionY[GROUPS], directionZ[GROUPS];
+			SIMD::Float a[GROUPS];
+			for (int group = 0; group < GROUPS; group++)
+			{
+				int lane = group * SIMD::Float::LANES;
+				originX[group] = SIMD::Float::Load(&packet.originX[lane]);
+				originY[group] = SIMD::Float::Load(&packet.originY[lane]);
+				originZ[group] = SIMD::Float::Load(&packet.originZ[lane]);
+				directionX[group] = SIMD::Float::Load(&packet.directionX[lane]);
+				directionY[group] = SIMD::Float::Load(&packet.directionY[lane]);
+				directionZ[group] = SIMD::Float::Load(&packet.directionZ[lane]);
+				a[group] = directionX[group] * directionX[group] + directionY[group] * directionY[group] + directionZ[group] * directionZ[group];
+			}
+
+			SIMD::Float minDistanceV(minDistance);
+			SIMD::Float zero(0.0f);
+
+			for (uint32_t i = begin; i < end; i++)
+			{
+				if (radiusSquared[i] == -INFINITY)
+				{
+					// not a sphere
+					continue;
+				}
+
+				SIMD::Float sphereX(centerX[i]), sphereY(centerY[i]), sphereZ(centerZ[i]), sphereRadiusSquared(radiusSquared[i]);
+
+				for (int group = 0; group < GROUPS; group++)
+				{
+					int firstLane = group * SIMD::Float::LANES;
+
+					SIMD::Float ccX = originX[group] - sphereX;
+					SIMD::Float ccY = originY[group] - sphereY;
+					SIMD::Float ccZ = originZ[group] - sphereZ;
+
+					SIMD::Float b = ccX * directionX[group] + ccY * directionY[group] + ccZ * directionZ[group];
+					SIMD::Float c = ccX * ccX + ccY * ccY + ccZ * ccZ - sphereRadiusSquared;
+					SIMD::Float discriminant = b * b - a[group] * c;
+
+					// nearest root: (-b - sqrt(discriminant)) / a
+					SIMD::Float t = (zero - (b + SIMD::Sqrt(discriminant))) / a[group];
+
+					SIMD::Float groupMaxDistances = SIMD::Float::Load(&maxDistances[firstLane]);
+					SIMD::Mask valid = (discriminant > zero) & (t >= minDistanceV) & (t <= groupMaxDistances);
+
+					int mask = SIMD::MoveMask(valid);
+					if (mask != 0)
+					{
+						SIMD::Select(valid, t, groupMaxDistances).Store(&maxDistances[firstLane]);
+						for (int lane = 0; mask != 0; lane++, mask >>= 1)
+						{
+							if ((mask & 1) != 0)
+							{
+								closest[firstLane + lane] = (int)i;
+							}
+						}
+					}
+				}
+			}
+
+			if (hasOtherShapes)
+			{
+				for (int lane = 0; lane < packet.count; lane++)
+				{
+					for (uint32_t j = begin; j < end; j++)
+					{
+						float t = 0.0f;
+						if (shapes[j].type != ShapeType::SPHERE && shapeArrays->Intersect(shapes[j], packet.rays[lane], minDistance, maxDistances[lane], t))
+						{
+							maxDistances[lane] = t;
+							closest[lane] = (int)j;
+						}
+					}
+				}
+			}
+		}
+
+		// fill the surface interaction of the ray hitting the shape at index at distance t
+		void SetHit(const Ray& ray, uint32_t index, float t, RaycastHit& raycastHit) const
+		{
+			if (radiusSquared[index] == -INFINITY)
+			{
+				// not a sphere
+				shapeArrays->SetHit(shapes[index], ray, t, raycastHit);
+				return;
+			}
+
+			glm::vec3 center(centerX[index], centerY[index], centerZ[index]);
+
+			raycastHit.hitDistance = t;
+			raycastHit.hitPos = ray.PointAtT(t);
+			raycastHit.hitNormal = glm::normalize(raycastHit.hitPos - center);
+			raycastHit.hitMaterialId = materials[index];
+		}
+
+	private:
+
+		// reserve
+		void Reserve(uint32_t count)
+		{
+			centerX.reserve(count + PADDING);
+			centerY.reserve(count + PADDING);
+			centerZ.reserve(count + PADDING);
+			radiusSquared.reserve(count + PADDING);
+			materials.reserve(count);
+			shapes.reserve(count);
+		}
+
+		// resize keeping the SIMD arrays padded. Slots of other shapes never hit as their radius squared is -inf
+		void Resize(uint32_t count)
+		{
+			centerX.resize(count + PADDING, 0.0f);
+			centerY.resize(count + PADDING, 0.0f);
+			centerZ.resize(count + PADDING, 0.0f);
+			radiusSquared.resize(count + PADDING, -INFINITY);
+			materials.resize(count, NO_MATERIAL);
+			shapes.resize(count, ShapeRef());
+		}
+
+		// bits of the lanes holding shapes when there are remaining shapes left
+		static int LaneMask(uint32_t remaining)
+		{
+			return remaining >= 8 ? 0xFF : (1 << remaining) - 1;
+		}
+
+		// pick the hit lanes in order so ties resolve as a sequential loop would
+		static bool SelectClosest(int mask, const float* distances, uint32_t first, float& maxDistance, int& closest)
+		{
+			bool hit = false;
+			for (int lane = 0; mask != 0; lane++, mask >>= 1)
+			{
+				if ((mask & 1) != 0 && distances[lane] <= maxDistance)
+				{
+					maxDistance = distances[lane];
+					closest = (int)(first + lane);
+					hit = true;
+				}
+			}
+
+			return hit;
+		}
+	};
+}
+
+#endif // !SPHERE_SOA_H
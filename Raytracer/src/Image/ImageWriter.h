@@ -0,0 +1,53 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+class ImageWriter
+{
+public:
+
+	// Write a RGBA float buffer (bottom-up rows, as used by glDrawPixels) into a binary PPM (P6) file
+	static bool WritePPM(const char* filePath, int width, int height, const float* buffer)
+	{
+		FILE* file = fopen(filePath, "wb");
+		if (!file)
+		{
+			return false;
+		}
+
+		fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+		// PPM rows go top-down so flip the buffer vertically while converting to bytes
+		std::vector<unsigned char> row(width * 3);
+		for (int y = height - 1; y >= 0; y--)
+		{
+			const float* pixel = buffer + (y * width * 4);
+			for (int x = 0; x < width; x++, pixel += 4)
+			{
+				row[x * 3 + 0] = ToByte(pixel[0]);
+				row[x * 3 + 1] = ToByte(pixel[1]);
+				row[x * 3 + 2] = ToByte(pixel[2]);
+			}
+
+			fwrite(row.data(), 1, row.size(), file);
+		}
+
+		bool success = (ferror(file) == 0);
+		fclose(file);
+
+		return success;
+	}
+
+private:
+
+	// clamp a colour channel to [0, 1] and convert it to a byte
+	static unsigned char ToByte(float channel)
+	{
+		return (unsigned char)(std::min(std::max(channel, 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+};
+
+#endif // !IMAGE_WRITER_H
@@ -2,32 +2,55 @@
 #define MATERIAL_H
 
 #include "../Geom3D/Geom3D.h"
+#include "../Sampler/Sampler.h"
 
+#include "MaterialDiffuse.h"
+#include "MaterialMetal.h"
+
+// material types, used to group hits that are shaded the same way
+enum class MaterialType
+{
+  DIFFUSE,
+  METAL,
+  COUNT
+};
+
+// Materials are plain values kept in the material table of the world and shaded by switching on their type,
+// so there are no virtual calls nor per shape allocations
 class Material
 {
+  // type
+  MaterialType type;
+
   // attenuation
   glm::vec3 attenuation;
 
 public:
- 
-  virtual ~Material() {};
 
-  virtual bool ScatterRay(const Geom3D::RaycastHit& hitInfo, glm::vec3& attenuationOut, Geom3D::Ray& rayOut) const = 0;
+  Material(MaterialType type_, const glm::vec3& attenuation_)
+    : type(type_)
+    , attenuation(attenuation_)
+  {
+  };
+
+  // scatter the ray hitting the surface. rayOut may be the same object as rayIn
+  bool ScatterRay(const Geom3D::Ray& rayIn, const Geom3D::RaycastHit& hitInfo, Sampler& sampler, glm::vec3& attenuationOut, Geom3D::Ray& rayOut) const
+  {
+    switch (type)
+    {
+    case MaterialType::DIFFUSE: return MaterialDiffuse::ScatterRay(attenuation, hitInfo, sampler, attenuationOut, rayOut);
+    case MaterialType::METAL: return MaterialMetal::ScatterRay(attenuation, rayIn, hitInfo, attenuationOut, rayOut);
+    default: return false;
+    }
+  }
 
   // getters/setters
+  MaterialType Type() const { return type; }
+
   const glm::vec3& Attenuation() const { return attenuation; }
   glm::vec3& Attenuation() { return attenuation; }
 
-protected:
-
-  Material(const glm::vec3& attenuation_)
-    :attenuation(attenuation_)
-  {
-  };
-
-private:
-
-  
+  bool operator==(const Material& other) const { return type == other.type && attenuation == other.attenuation; }
 };
 
 #endif // !MATERIAL_H
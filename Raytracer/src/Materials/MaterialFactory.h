@@ -1,6 +1,9 @@
 #ifndef MATERIAL_FACTORY_H
 #define MATERIAL_FACTORY_H
 
+#include <cassert>
+#include <string>
+
 #include "Materials.h"
 
 struct MaterialFactoryParams
@@ -13,21 +16,21 @@ class MaterialFactory
 {
 public:
 
-  static std::shared_ptr<Material> Create(const MaterialFactoryParams& params)
+  static Material Create(const MaterialFactoryParams& params)
   {
-    std::shared_ptr<Material> material;
+    MaterialType type = MaterialType::COUNT;
     if (params.materialType == "Diffuse")
     {
-      material = std::make_shared<MaterialDiffuse>(params.materialColour);
+      type = MaterialType::DIFFUSE;
     }
     else if (params.materialType == "Metal")
     {
-      material = std::make_shared<MaterialMetal>(params.materialColour);
+      type = MaterialType::METAL;
     }
 
-    assert(material);
+    assert(type != MaterialType::COUNT);
 
-    return material;
+    return Material(type, params.materialColour);
   }
 };
 
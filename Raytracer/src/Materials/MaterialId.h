@@ -0,0 +1,12 @@
+#ifndef MATERIAL_ID_H
+#define MATERIAL_ID_H
+
+#include <cstdint>
+
+// index of a material in the material table of the world
+typedef uint32_t MaterialId;
+
+// id of shapes and hits without a material
+static const MaterialId NO_MATERIAL = UINT32_MAX;
+
+#endif // !MATERIAL_ID_H
@@ -0,0 +1,141 @@
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Material.h"
+#include "MaterialId.h"
+#include "../Memory/SceneAllocator.h"
+#include "../Snapshot/Snapshot.h"
+
+// Flat table of the materials of a scene. Shapes and hits refer to materials by their index in the table
+// and identical materials share a single entry
+class MaterialTable
+{
+  // materials
+  SceneVector<Material> materials;
+
+  // Open addressing hash set of the ids in the table, used to find identical materials
+  // Note: kept at most half full and its size is a power of two
+  SceneVector<MaterialId> slots;
+
+public:
+
+  // add a material and return its id, or the id of an identical one already in the table
+  MaterialId Add(const Material& material)
+  {
+    if ((materials.size() + 1) * 2 > slots.size())
+    {
+      Rehash(std::max((size_t)64, slots.size() * 2));
+    }
+
+    size_t mask = slots.size() - 1;
+    for (size_t slot = Hash(material) & mask; ; slot = (slot + 1) & mask)
+    {
+      MaterialId id = slots[slot];
+      if (id == NO_MATERIAL)
+      {
+        id = (MaterialId)materials.size();
+        materials.push_back(material);
+        slots[slot] = id;
+        return id;
+      }
+
+      if (materials[id] == material)
+      {
+        return id;
+      }
+    }
+  }
+
+  // clear
+  void Clear()
+  {
+    materials.clear();
+    slots.clear();
+  }
+
+  // save/load to/from a snapshot
+  void Save(Snapshot::Writer& writer) const
+  {
+    writer.WriteArray(materials);
+    writer.WriteArray(slots);
+  }
+
+  bool Load(Snapshot::Reader& reader)
+  {
+    return reader.ReadArray(materials) && reader.ReadArray(slots);
+  }
+
+  // whether the material types are known and the hash set is a power of two at most half full of ids in the table,
+  // to check loaded snapshots
+  bool IsValid() const
+  {
+    for (const Material& material : materials)
+    {
+      if ((uint32_t)material.Type() >= (uint32_t)MaterialType::COUNT)
+      {
+        return false;
+      }
+    }
+
+    if ((slots.size() & (slots.size() - 1)) != 0 || materials.size() * 2 > slots.size())
+    {
+      return false;
+    }
+
+    for (MaterialId id : slots)
+    {
+      if (id != NO_MATERIAL && id >= materials.size())
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  // getters
+  uint32_t Size() const { return (uint32_t)materials.size(); }
+  const Material& operator[](MaterialId id) const { return materials[id]; }
+
+private:
+
+  // rebuild the hash set with a number of slots
+  void Rehash(size_t slotsCount)
+  {
+    slots.assign(slotsCount, NO_MATERIAL);
+
+    size_t mask = slotsCount - 1;
+    for (MaterialId id = 0; id < (MaterialId)materials.size(); id++)
+    {
+      size_t slot = Hash(materials[id]) & mask;
+      while (slots[slot] != NO_MATERIAL)
+      {
+        slot = (slot + 1) & mask;
+      }
+      slots[slot] = id;
+    }
+  }
+
+  // hash of the material parameters
+  static size_t Hash(const Material& material)
+  {
+    uint64_t hash = (uint64_t)material.Type();
+    for (int i = 0; i < 3; i++)
+    {
+      // Note: adding 0 turns -0 into +0 so materials that compare equal hash the same
+      float value = material.Attenuation()[i] + 0.0f;
+      uint32_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+      hash = (hash ^ bits) * 0x9E3779B97F4A7C15ull;
+    }
+
+    return (size_t)(hash ^ (hash >> 32));
+  }
+};
+
+#endif // !MATERIAL_TABLE_H
@@ -2,7 +2,6 @@
 #define MATERIALS_H
 
 #include "Material.h"
-#include "MaterialDiffuse.h"
-#include "MaterialMetal.h"
+#include "MaterialTable.h"
 
 #endif // !MATERIALS_H
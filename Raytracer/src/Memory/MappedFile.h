@@ -0,0 +1,149 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read only memory mapping of a whole file
+// Pages are loaded on demand and shared with any other process mapping the same file
+class MappedFile
+{
+	const char* data = nullptr;
+	size_t size = 0;
+	bool isOpen = false;
+
+#if defined(_WIN32)
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+
+public:
+
+	MappedFile() {};
+
+	MappedFile(const char* path)
+	{
+		Open(path);
+	}
+
+	~MappedFile()
+	{
+		Close();
+	}
+
+	MappedFile(const MappedFile& other) = delete;
+	MappedFile& operator=(const MappedFile& other) = delete;
+
+	// map a file. Returns false if it can not be opened
+	bool Open(const char* path)
+	{
+		Close();
+
+#if defined(_WIN32)
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize))
+		{
+			Close();
+			return false;
+		}
+
+		size = (size_t)fileSize.QuadPart;
+		if (size > 0)
+		{
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			data = mapping ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+			if (!data)
+			{
+				Close();
+				return false;
+			}
+		}
+#else
+		int file = open(path, O_RDONLY);
+		if (file < 0)
+		{
+			return false;
+		}
+
+		struct stat fileStat;
+		if (fstat(file, &fileStat) != 0)
+		{
+			close(file);
+			return false;
+		}
+
+		size = (size_t)fileStat.st_size;
+		if (size > 0)
+		{
+			void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+			if (mapping == MAP_FAILED)
+			{
+				close(file);
+				size = 0;
+				return false;
+			}
+			data = static_cast<const char*>(mapping);
+		}
+
+		// Note: the mapping stays valid after closing the file
+		close(file);
+#endif
+
+		isOpen = true;
+		return true;
+	}
+
+	// unmap
+	void Close()
+	{
+#if defined(_WIN32)
+		if (data)
+		{
+			UnmapViewOfFile(data);
+		}
+		if (mapping)
+		{
+			CloseHandle(mapping);
+		}
+		if (file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(file);
+		}
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (data)
+		{
+			munmap(const_cast<char*>(data), size);
+		}
+#endif
+
+		data = nullptr;
+		size = 0;
+		isOpen = false;
+	}
+
+	// getters
+	bool IsOpen() const { return isOpen; }
+	const char* Data() const { return data; }
+	size_t Size() const { return size; }
+};
+
+#endif // !MAPPED_FILE_H
@@ -0,0 +1,126 @@
+#ifndef SCENE_ALLOCATOR_H
+#define SCENE_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Allocator for the big arrays of a scene: shapes, materials and acceleration structures.
+//
+// Every array is a single contiguous block, so a scene is a handful of allocations no matter how many primitives
+// it has, all released by World::Clear. On Linux blocks of at least HUGE_PAGE_SIZE are mapped directly, aligned to
+// huge pages and advised to be backed by transparent huge pages, so traversals jumping across millions of
+// primitives take fewer TLB misses. Their size is only rounded up to regular pages: the kernel backs the whole huge
+// pages with huge pages and the tail with regular ones. Smaller blocks and other platforms use the heap.
+template<typename T>
+class SceneAllocator
+{
+public:
+
+	typedef T value_type;
+
+	// size of a transparent huge page
+	static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+	SceneAllocator() = default;
+
+	template<typename U>
+	SceneAllocator(const SceneAllocator<U>&) {}
+
+	// allocate
+	T* allocate(size_t count)
+	{
+		size_t bytes = count * sizeof(T);
+
+#if defined(__linux__)
+		if (bytes >= HUGE_PAGE_SIZE)
+		{
+			// map an extra huge page and trim the unaligned head and tail
+			size_t size = RoundUp(bytes, PageSize());
+			void* mapping = mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mapping == MAP_FAILED)
+			{
+				throw std::bad_alloc();
+			}
+
+			char* begin = static_cast<char*>(mapping);
+			char* aligned = reinterpret_cast<char*>(RoundUp(reinterpret_cast<uintptr_t>(begin), HUGE_PAGE_SIZE));
+			if (aligned > begin)
+			{
+				munmap(begin, aligned - begin);
+			}
+			munmap(aligned + size, begin + size + HUGE_PAGE_SIZE - (aligned + size));
+
+			// Note: only a hint, the kernel falls back to regular pages when huge pages are disabled
+			madvise(aligned, size, MADV_HUGEPAGE);
+
+			return reinterpret_cast<T*>(aligned);
+		}
+#endif
+
+		if (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+		{
+			return static_cast<T*>(::operator new(bytes, std::align_val_t(alignof(T))));
+		}
+
+		return static_cast<T*>(::operator new(bytes));
+	}
+
+	// deallocate
+	void deallocate(T* memory, size_t count)
+	{
+		size_t bytes = count * sizeof(T);
+
+#if defined(__linux__)
+		if (bytes >= HUGE_PAGE_SIZE)
+		{
+			munmap(memory, RoundUp(bytes, PageSize()));
+			return;
+		}
+#endif
+
+		if (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+		{
+			::operator delete(memory, std::align_val_t(alignof(T)));
+			return;
+		}
+
+		::operator delete(memory);
+	}
+
+	// all scene allocators can free each other's memory
+	template<typename U>
+	bool operator==(const SceneAllocator<U>&) const { return true; }
+
+	template<typename U>
+	bool operator!=(const SceneAllocator<U>&) const { return false; }
+
+private:
+
+	// round up to a multiple of a power of two
+	static size_t RoundUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+#if defined(__linux__)
+	// size of a regular page
+	static size_t PageSize()
+	{
+		static const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+		return pageSize;
+	}
+#endif
+};
+
+// vector allocated with the scene allocator
+template<typename T>
+using SceneVector = std::vector<T, SceneAllocator<T>>;
+
+#endif // !SCENE_ALLOCATOR_H
@@ -0,0 +1,83 @@
+#ifndef PARSE_NUMBER_H
+#define PARSE_NUMBER_H
+
+#include <charconv>
+#include <cstdint>
+#include <string_view>
+
+// Number parsing straight from text in memory, with no temporaries and no locale
+// Functions work like std::from_chars: they parse the longest number at the start of [first, last) and return
+// where it ends, so callers check the separator that follows
+namespace Parsing
+{
+	// Parse a float
+	// Plain decimals with a mantissa up to 2^24 and up to 10 decimals, which is what scene and config files are
+	// mostly made of, are computed as mantissa / 10^decimals. Both are exact floats, so the single division rounds
+	// exactly as std::from_chars would. Anything else, like exponents or longer mantissas, goes to std::from_chars
+	inline std::from_chars_result ParseFloat(const char* first, const char* last, float& value)
+	{
+		static const float POWERS_OF_TEN[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+		const char* c = first;
+		bool negative = c < last && *c == '-';
+		if (negative)
+		{
+			c++;
+		}
+
+		uint32_t mantissa = 0;
+		int digits = 0;
+		int decimals = 0;
+		bool point = false;
+		for (; c < last && digits <= 9; c++)
+		{
+			if (*c >= '0' && *c <= '9')
+			{
+				mantissa = mantissa * 10 + (*c - '0');
+				digits++;
+				decimals += point;
+			}
+			else if (*c == '.' && !point)
+			{
+				point = true;
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		bool exponent = c < last && (*c == 'e' || *c == 'E');
+		if (digits == 0 || digits > 9 || exponent || mantissa > (1u << 24) || decimals > 10)
+		{
+			return std::from_chars(first, last, value);
+		}
+
+		value = (float)mantissa / POWERS_OF_TEN[decimals];
+		value = negative ? -value : value;
+		return { c, std::errc() };
+	}
+
+	// Parse an integer
+	template<typename T>
+	std::from_chars_result ParseInt(const char* first, const char* last, T& value)
+	{
+		return std::from_chars(first, last, value);
+	}
+
+	// Parse a whole token. Returns false unless all of it is a number
+	inline bool ParseFloat(std::string_view token, float& value)
+	{
+		std::from_chars_result result = ParseFloat(token.data(), token.data() + token.size(), value);
+		return result.ec == std::errc() && result.ptr == token.data() + token.size();
+	}
+
+	template<typename T>
+	bool ParseInt(std::string_view token, T& value)
+	{
+		std::from_chars_result result = ParseInt(token.data(), token.data() + token.size(), value);
+		return result.ec == std::errc() && result.ptr == token.data() + token.size();
+	}
+}
+
+#endif // !PARSE_NUMBER_H
@@ -1,212 +1,702 @@
 #ifndef BVH_H
 #define BVH_H
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
 #include "../Geom3D/Geom3D.h"
+#include "../Memory/SceneAllocator.h"
+#include "../Snapshot/Snapshot.h"
+#include "../ThreadPool/WorkStealingThreadPool.h"
+
+// BVH node (32 bytes)
+// Nodes are stored depth first in a single array, so the left child of an interior node is always the next node
+struct BVHNode
+{
+	// bounds of everything below the node
+	Geom3D::AABB aabb;
+
+	// interior node: index of the right child. Leaf: index of its first primitive
+	uint32_t offset = 0;
+
+	// number of primitives of a leaf, 0 for interior nodes
+	uint16_t primitivesCount = 0;
+
+	// interior node: axis its children were split on, so traversal can visit the nearer child first
+	uint8_t splitAxis = 0;
 
+	uint8_t padding = 0;
 
-class BVH : public Geom3D::Shape
+	bool IsLeaf() const { return primitivesCount > 0; }
+};
+
+// BVH split methods
+enum class BVHSplitMethod
 {
-	// pointer to children
-	std::shared_ptr<Geom3D::Shape> left;
-	std::shared_ptr<Geom3D::Shape> right;
+	// binned Surface Area Heuristic over the three axes
+	SAH,
+
+	// split in half according to AABB min position in X
+	MEDIAN
+};
 
-	// is leaf node
-	bool isLastInBVH = false;
+// BVH build settings
+struct BVHBuildSettings
+{
+	BVHSplitMethod splitMethod = BVHSplitMethod::SAH;
 
-#if PROFILE_HIT_TEST
-	// tracks the number of hit test done
-	std::atomic<uint64_t> hitTestCount = 0;
-#endif
+	// max number of primitives in a leaf
+	uint32_t maxLeafPrimitives = 4;
 
-public:
+	// children per node used for traversal: 2 keeps the binary BVH, 4 or 8 collapse it into a wide BVH
+	uint32_t width = 2;
+};
+
+// Bounding Volume Hierarchy flattened into a node array. Leaves reference contiguous ranges of primitives by index.
+// Traversal lives in World::Raycast.
+//
+// When a thread pool is given the build runs in parallel: big subtrees are built as tasks and the bounds,
+// SAH binning and partitioning of big nodes are split in chunks across the workers. The resulting tree does
+// not depend on the number of threads.
+class BVH
+{
+	// nodes, the root is the first one
+	SceneVector<BVHNode> nodes;
 
-	// build
-	void Build(std::vector<std::shared_ptr<Geom3D::Shape>>& shapes)
+	// shapes referenced by the leaves, ordered so every leaf references a contiguous range
+	SceneVector<Geom3D::ShapeRef> primitives;
+
+	// build settings
+	BVHBuildSettings settings;
+
+	// primitive data only needed while building
+	struct BuildPrimitive
 	{
-		// order shapes
-		std::sort(shapes.begin(), shapes.end(), BVH::SortFunc);
+		Geom3D::AABB aabb;
+		glm::vec3 centroid;
+		Geom3D::ShapeRef shape;
+	};
 
-		// Recursively Build BVH
-		RecursivelyBuildBVH(shapes);
-	}
+	// SAH bins per axis
+	static const int SAH_BINS = 16;
 
-	// calculate AABB
-	void CalculateAABB()
+	// SAH bins of the three axes
+	struct SAHBins
 	{
-		// the bounding box tha contains left and right AABB
+		Geom3D::AABB bounds[3][SAH_BINS];
+		uint32_t counts[3][SAH_BINS] = {};
+	};
 
-		auto& leftMin = left->GetAABB().Min();
-		auto& rightMin = right->GetAABB().Min();
+	// SAH cost of traversing a node relative to intersecting a primitive
+	static constexpr float SAH_TRAVERSAL_COST = 1.0f;
 
-		aabb.Min() = glm::vec3(std::fminf(leftMin.x, rightMin.x), std::fminf(leftMin.y, rightMin.y), std::fminf(leftMin.z, rightMin.z));
+	// below this depth only median splits are done, so the tree never gets deeper than MAX_DEPTH
+	static const int SAH_MAX_DEPTH = 32;
 
-		auto& leftMax = left->GetAABB().Max();
-		auto& rightMax = right->GetAABB().Max();
+	// subtrees with at least this many primitives are built as a separate task
+	static const uint32_t PARALLEL_SUBTREE_MIN_PRIMITIVES = 8 * 1024;
 
-		aabb.Max() = glm::vec3(std::fmaxf(leftMax.x, rightMax.x), std::fmaxf(leftMax.y, rightMax.y), std::fmaxf(leftMax.z, rightMax.z));
-	}
+	// nodes with at least this many primitives split their bounds, binning and partitioning across the workers
+	// Note: they are partitioned stably even without workers, so the tree is the same whatever the number of threads
+	static const uint32_t PARALLEL_NODE_MIN_PRIMITIVES = 128 * 1024;
+
+	// thread pool used while building, null to build in the calling thread
+	WorkStealingThreadPool* threadPool = nullptr;
+
+	// scratch buffer for the stable partition
+	SceneVector<BuildPrimitive> partitionBuffer;
+
+	// per chunk results of a node split in chunks
+	struct ChunkScratch
+	{
+		std::vector<Geom3D::AABB> bounds;
+		std::vector<SAHBins> bins;
+		std::vector<uint32_t> leftCounts;
+		std::vector<uint32_t> leftOffsets;
+		std::vector<uint32_t> rightOffsets;
+		std::vector<ThreadTaskResult> taskResults;
+	};
+
+	// Chunk scratch not in use, kept for the whole build so nodes split in chunks do not allocate
+	// Note: several nodes can be split in chunks at once, even nested in the same thread as it runs other tasks while
+	// waiting for its chunks, so every node takes a scratch of its own and gives it back when done
+	struct ChunkScratchList
+	{
+		std::mutex mutex;
+		std::vector<std::unique_ptr<ChunkScratch>> scratches;
+	};
+	ChunkScratchList* chunkScratchList = nullptr;
 
-	// Raycast
-	bool Raycast(const Geom3D::Ray& ray, float minDistance, float maxDistance, Geom3D::RaycastHit& raycastHit) override
+	// chunk scratch taken from the list while in scope
+	class ScopedChunkScratch
 	{
-		#if PROFILE_HIT_TEST
-		hitTestCount++; // count hit test for current BVH
-		#endif
+		ChunkScratchList& list;
+		std::unique_ptr<ChunkScratch> scratch;
 
-		// Raycast with children if we only intersect current aabb
-		float tMin = 0.0f;
-		float tMax = 0.0f;
-		if (!aabb.Intersect(ray, tMin, tMax))
+	public:
+
+		ScopedChunkScratch(ChunkScratchList& list_)
+			: list(list_)
+		{
+			std::lock_guard<std::mutex> lock(list.mutex);
+			if (list.scratches.empty())
+			{
+				scratch.reset(new ChunkScratch());
+			}
+			else
+			{
+				scratch = std::move(list.scratches.back());
+				list.scratches.pop_back();
+			}
+		}
+
+		~ScopedChunkScratch()
 		{
-			// No intersection so no need to check children
-			return false;
+			std::lock_guard<std::mutex> lock(list.mutex);
+			list.scratches.push_back(std::move(scratch));
 		}
 
-		// Left Raycast
-		Geom3D::RaycastHit leftRaycastHit;
-		bool hitLeft = left->Raycast(ray, minDistance, maxDistance, leftRaycastHit);
-		
+		ScopedChunkScratch(const ScopedChunkScratch& other) = delete;
+		ScopedChunkScratch& operator=(const ScopedChunkScratch& other) = delete;
+
+		ChunkScratch* operator->() { return scratch.get(); }
+	};
+
+public:
+
+	// max depth of the tree. Traversal stacks are sized after it
+	static const int MAX_DEPTH = 64;
 
-		// Right Raycast
-		Geom3D::RaycastHit rightRaycastHit;
-		bool hitRight = right->Raycast(ray, minDistance, maxDistance, rightRaycastHit);
+	// max primitives a leaf can reference
+	static constexpr uint32_t MAX_LEAF_PRIMITIVES = UINT16_MAX;
+
+	// build over the shapes given, which must be bounded
+	void Build(const Geom3D::ShapeArrays& shapeArrays, const SceneVector<Geom3D::ShapeRef>& shapes, const BVHBuildSettings& buildSettings = BVHBuildSettings(), WorkStealingThreadPool* buildThreadPool = nullptr)
+	{
+		Clear();
+
+		settings = buildSettings;
+		settings.maxLeafPrimitives = std::min(std::max(settings.maxLeafPrimitives, 1u), MAX_LEAF_PRIMITIVES);
+
+		// Note: with a single hardware thread the parallel build only adds overhead
+		threadPool = std::thread::hardware_concurrency() > 1 ? buildThreadPool : nullptr;
+
+		ChunkScratchList scratchList;
+		chunkScratchList = &scratchList;
+
+		if (shapes.empty())
+		{
+			threadPool = nullptr;
+			chunkScratchList = nullptr;
+			return;
+		}
+
+		uint32_t count = (uint32_t)shapes.size();
+
+		SceneVector<BuildPrimitive> buildPrimitives(count);
+		ForEachChunk(0, count, [&](uint32_t, uint32_t chunkBegin, uint32_t chunkEnd)
+		{
+			for (uint32_t i = chunkBegin; i < chunkEnd; i++)
+			{
+				Geom3D::AABB aabb = shapeArrays.GetAABB(shapes[i]);
+				buildPrimitives[i] = { aabb, aabb.Center(), shapes[i] };
+			}
+		});
 
-#if PROFILE_HIT_TEST
-		if (isLastInBVH)
+		if (count >= PARALLEL_NODE_MIN_PRIMITIVES)
 		{
-			// count hit test for leaf children
-			hitTestCount += 2;
+			partitionBuffer.resize(count);
 		}
-#endif
 
-		if (hitLeft && hitRight)
+		// a binary tree with at least one primitive per leaf has less than twice as many nodes as primitives
+		nodes.reserve(2 * count);
+		BuildNode(nodes, buildPrimitives, 0, count, 0);
+
+		// store the primitives in the order the leaves reference them
+		primitives.resize(count);
+		ForEachChunk(0, count, [&](uint32_t, uint32_t chunkBegin, uint32_t chunkEnd)
+		{
+			for (uint32_t i = chunkBegin; i < chunkEnd; i++)
+			{
+				primitives[i] = buildPrimitives[i].shape;
+			}
+		});
+
+		threadPool = nullptr;
+		chunkScratchList = nullptr;
+		partitionBuffer.clear();
+		partitionBuffer.shrink_to_fit();
+	}
+
+	// clear
+	void Clear()
+	{
+		nodes.clear();
+		primitives.clear();
+	}
+
+	// save/load to/from a snapshot
+	void Save(Snapshot::Writer& writer) const
+	{
+		writer.WriteArray(nodes);
+		writer.WriteArray(primitives);
+	}
+
+	bool Load(Snapshot::Reader& reader)
+	{
+		return reader.ReadArray(nodes) && reader.ReadArray(primitives);
+	}
+
+	// Whether the nodes form a tree no deeper than MAX_DEPTH whose children, split axes and primitive ranges are in
+	// bounds and whose primitives are in the shape arrays, to check loaded snapshots
+	bool IsValid(const Geom3D::ShapeArrays& shapeArrays) const
+	{
+		for (Geom3D::ShapeRef primitive : primitives)
 		{
-			// return the closest hit
-			raycastHit = leftRaycastHit.hitDistance < rightRaycastHit.hitDistance ? leftRaycastHit : rightRaycastHit;
-			return true;
+			if (!shapeArrays.IsValid(primitive))
+			{
+				return false;
+			}
 		}
 
-		if (hitLeft)
+		if (nodes.empty())
 		{
-			// return left
-			raycastHit = leftRaycastHit;
-			return true;
+			return primitives.empty();
 		}
-		
-		if (hitRight)
+
+		// every node must be reached once, so shared or cyclic children are rejected
+		std::vector<bool> visited(nodes.size(), false);
+		std::vector<std::pair<uint32_t, int>> stack(1, { 0, 0 });
+		while (!stack.empty())
 		{
-			// return right
-			raycastHit = rightRaycastHit;
-			return true;
+			uint32_t nodeIndex = stack.back().first;
+			int depth = stack.back().second;
+			stack.pop_back();
+
+			if (nodeIndex >= nodes.size() || visited[nodeIndex] || depth >= MAX_DEPTH)
+			{
+				return false;
+			}
+
+			visited[nodeIndex] = true;
+
+			const BVHNode& node = nodes[nodeIndex];
+			if (node.IsLeaf())
+			{
+				if (node.offset > primitives.size() || node.primitivesCount > primitives.size() - node.offset)
+				{
+					return false;
+				}
+			}
+			else
+			{
+				if (node.splitAxis >= 3)
+				{
+					return false;
+				}
+
+				stack.push_back({ nodeIndex + 1, depth + 1 });
+				stack.push_back({ node.offset, depth + 1 });
+			}
 		}
 
-		return false;
+		return true;
 	}
 
-#if PROFILE_HIT_TEST
-	// Hit test count
-	void ResetHitTestCount()
-	{ 
-		hitTestCount = 0; 
+	// getters
+	bool IsEmpty() const { return nodes.empty(); }
+	const SceneVector<BVHNode>& Nodes() const { return nodes; }
+	const SceneVector<Geom3D::ShapeRef>& Primitives() const { return primitives; }
+
+private:
+
+	// build the node for the primitives in [begin, end) at the end of outNodes and return its index
+	// Note: interior node offsets are relative to the start of outNodes, leaf offsets are primitive indices
+	uint32_t BuildNode(SceneVector<BVHNode>& outNodes, SceneVector<BuildPrimitive>& buildPrimitives, uint32_t begin, uint32_t end, int depth)
+	{
+		assert(depth < MAX_DEPTH);
 
-		if (!isLastInBVH)
+		uint32_t nodeIndex = (uint32_t)outNodes.size();
+		outNodes.emplace_back();
+
+		// calculate AABB of the primitives and of their centroids
+		Geom3D::AABB aabb;
+		Geom3D::AABB centroidBounds;
+		CalculateBounds(buildPrimitives, begin, end, aabb, centroidBounds);
+		outNodes[nodeIndex].aabb = aabb;
+
+		uint32_t count = end - begin;
+		if (count == 1)
 		{
-			auto leftBHV = static_cast<BVH*>(&*left);
-			leftBHV->ResetHitTestCount();
+			return MakeLeaf(outNodes, nodeIndex, begin, count);
+		}
 
-			auto rightBVH = static_cast<BVH*>(&*right);
-			rightBVH->ResetHitTestCount();
+		uint32_t middle = begin;
+		int splitAxis = 0;
+		if (settings.splitMethod == BVHSplitMethod::SAH && depth < SAH_MAX_DEPTH)
+		{
+			middle = SplitSAH(buildPrimitives, begin, end, aabb, centroidBounds, splitAxis);
+			if (middle == end)
+			{
+				// making a leaf is cheaper than any split
+				return MakeLeaf(outNodes, nodeIndex, begin, count);
+			}
 		}
-	}
 
-	uint64_t GetHitTestCount() 
-	{ 
-		if (isLastInBVH)
+		if (middle == begin)
 		{
-			return hitTestCount;
+			// median split, also used when the SAH can not split the primitives
+			if (count <= settings.maxLeafPrimitives)
+			{
+				return MakeLeaf(outNodes, nodeIndex, begin, count);
+			}
+
+			middle = SplitMedian(buildPrimitives, begin, end);
+			splitAxis = 0;
 		}
 
-		auto leftBHV = static_cast<BVH*>(&*left);
-		hitTestCount += leftBHV->GetHitTestCount();
+		uint32_t rightIndex = 0;
+		if (threadPool && count >= PARALLEL_SUBTREE_MIN_PRIMITIVES)
+		{
+			// build the right child into its own nodes as a task while this thread builds the left one
+			SceneVector<BVHNode> rightNodes;
+			auto taskResult = threadPool->AddTask([&, middle, end, depth]()
+			{
+				rightNodes.reserve(2 * (end - middle));
+				BuildNode(rightNodes, buildPrimitives, middle, end, depth + 1);
+			});
+
+			BuildNode(outNodes, buildPrimitives, begin, middle, depth + 1);
+
+			threadPool->WaitForTask(taskResult);
+
+			// append the right child nodes rebasing their child indices
+			rightIndex = (uint32_t)outNodes.size();
+			for (auto& node : rightNodes)
+			{
+				outNodes.push_back(node);
+				if (!node.IsLeaf())
+				{
+					outNodes.back().offset += rightIndex;
+				}
+			}
+		}
+		else
+		{
+			// left child is the next node, so only the right child index needs to be stored
+			BuildNode(outNodes, buildPrimitives, begin, middle, depth + 1);
+			rightIndex = BuildNode(outNodes, buildPrimitives, middle, end, depth + 1);
+		}
 
-		auto rightBVH = static_cast<BVH*>(&*right);
-		hitTestCount += rightBVH->GetHitTestCount();
+		// Note: nodes may have been reallocated by the children so access by index
+		outNodes[nodeIndex].offset = rightIndex;
+		outNodes[nodeIndex].splitAxis = (uint8_t)splitAxis;
 
-		return hitTestCount; 
+		return nodeIndex;
 	}
-#endif
 
-private:
+	// make a leaf node
+	uint32_t MakeLeaf(SceneVector<BVHNode>& outNodes, uint32_t nodeIndex, uint32_t begin, uint32_t count)
+	{
+		outNodes[nodeIndex].offset = begin;
+		outNodes[nodeIndex].primitivesCount = (uint16_t)count;
+		return nodeIndex;
+	}
 
-	// Build BVH
-	void RecursivelyBuildBVH(std::vector<std::shared_ptr<Geom3D::Shape>>& shapes)
+	// calculate the AABB of the primitives in [begin, end) and the AABB of their centroids
+	void CalculateBounds(const SceneVector<BuildPrimitive>& buildPrimitives, uint32_t begin, uint32_t end, Geom3D::AABB& aabb, Geom3D::AABB& centroidBounds)
 	{
-		// Set children
-		SetChildren(shapes);
+		auto growBounds = [&buildPrimitives](uint32_t chunkBegin, uint32_t chunkEnd, Geom3D::AABB& chunkAABB, Geom3D::AABB& chunkCentroidBounds)
+		{
+			for (uint32_t i = chunkBegin; i < chunkEnd; i++)
+			{
+				chunkAABB.Grow(buildPrimitives[i].aabb);
+				chunkCentroidBounds.Grow(Geom3D::AABB(buildPrimitives[i].centroid, buildPrimitives[i].centroid));
+			}
+		};
+
+		uint32_t chunksCount = ChunksCount(begin, end);
+		if (chunksCount == 1)
+		{
+			growBounds(begin, end, aabb, centroidBounds);
+			return;
+		}
 
-		// Calculate AABB
-		CalculateAABB();
+		ScopedChunkScratch scratch(*chunkScratchList);
+		std::vector<Geom3D::AABB>& chunkBounds = scratch->bounds;
+		chunkBounds.assign(2 * chunksCount, Geom3D::AABB());
+		ForEachChunk(begin, end, [&](uint32_t chunk, uint32_t chunkBegin, uint32_t chunkEnd)
+		{
+			growBounds(chunkBegin, chunkEnd, chunkBounds[2 * chunk], chunkBounds[2 * chunk + 1]);
+		});
+
+		for (size_t chunk = 0; chunk < chunkBounds.size(); chunk += 2)
+		{
+			aabb.Grow(chunkBounds[chunk]);
+			centroidBounds.Grow(chunkBounds[chunk + 1]);
+		}
 	}
 
-	// Set children
-	void SetChildren(std::vector<std::shared_ptr<Geom3D::Shape>>& shapes)
+	// split the primitives in half according to AABB min position in X
+	uint32_t SplitMedian(SceneVector<BuildPrimitive>& buildPrimitives, uint32_t begin, uint32_t end)
 	{
-		switch (shapes.size())
+		uint32_t middle = begin + (end - begin) / 2;
+		std::nth_element(buildPrimitives.begin() + begin, buildPrimitives.begin() + middle, buildPrimitives.begin() + end,
+			[](const BuildPrimitive& a, const BuildPrimitive& b) { return a.aabb.Min().x < b.aabb.Min().x; });
+
+		return middle;
+	}
+
+	// Split the primitives with the binned Surface Area Heuristic
+	// Returns the index of the first primitive of the right child, end if a leaf is cheaper than any split
+	// or begin if the centroids can not be binned and the caller must fall back to the median split
+	uint32_t SplitSAH(SceneVector<BuildPrimitive>& buildPrimitives, uint32_t begin, uint32_t end, const Geom3D::AABB& aabb, const Geom3D::AABB& centroidBounds, int& splitAxis)
+	{
+		uint32_t count = end - begin;
+
+		glm::vec3 extent = centroidBounds.Max() - centroidBounds.Min();
+		glm::vec3 binScale;
+		for (int axis = 0; axis < 3; axis++)
 		{
-		case 0:
-			assert(false);
-			break;
-		case 1:
-			// make both point to single shape
-			left = right = shapes[0];
+			binScale[axis] = extent[axis] > 0.0f ? SAH_BINS / extent[axis] : 0.0f;
+		}
 
-			// flag as the last BV in the hierarchy
-			isLastInBVH = true;
-			break;
-		case 2:
-			// make the left to point to the first and right to the second
-			left = shapes[0];
-			right = shapes[1];
+		// bin the primitives by centroid on the three axes at once
+		auto binPrimitives = [&](uint32_t chunkBegin, uint32_t chunkEnd, SAHBins& chunkBins)
+		{
+			for (uint32_t i = chunkBegin; i < chunkEnd; i++)
+			{
+				for (int axis = 0; axis < 3; axis++)
+				{
+					int bin = BinIndex(buildPrimitives[i].centroid[axis], centroidBounds.Min()[axis], binScale[axis]);
+					chunkBins.bounds[axis][bin].Grow(buildPrimitives[i].aabb);
+					chunkBins.counts[axis][bin]++;
+				}
+			}
+		};
 
-			// flag as the last BV in the hierarchy
-			isLastInBVH = true;
-			break;
-		default:
+		SAHBins bins;
+		uint32_t chunksCount = ChunksCount(begin, end);
+		if (chunksCount == 1)
+		{
+			binPrimitives(begin, end, bins);
+		}
+		else
 		{
-			// recursively construct a new BVH that holds half of the shapes
-			unsigned halfShapes = shapes.size() / 2;
+			ScopedChunkScratch scratch(*chunkScratchList);
+			std::vector<SAHBins>& chunkBins = scratch->bins;
+			chunkBins.assign(chunksCount, SAHBins());
+			ForEachChunk(begin, end, [&](uint32_t chunk, uint32_t chunkBegin, uint32_t chunkEnd)
+			{
+				binPrimitives(chunkBegin, chunkEnd, chunkBins[chunk]);
+			});
 
-			std::vector<std::shared_ptr<Geom3D::Shape>> leftShapes;
-			for (unsigned i = 0; i < halfShapes; i++)
+			for (uint32_t chunk = 0; chunk < chunksCount; chunk++)
 			{
-				leftShapes.emplace_back(shapes[i]);
+				for (int axis = 0; axis < 3; axis++)
+				{
+					for (int bin = 0; bin < SAH_BINS; bin++)
+					{
+						bins.bounds[axis][bin].Grow(chunkBins[chunk].bounds[axis][bin]);
+						bins.counts[axis][bin] += chunkBins[chunk].counts[axis][bin];
+					}
+				}
 			}
-			auto& newLeftBHV = std::make_shared<BVH>();
-			newLeftBHV->Build(leftShapes);
-			left = newLeftBHV;
+		}
+
+		float bestCost = FLT_MAX;
+		int bestAxis = -1;
+		int bestBin = 0;
 
-			std::vector<std::shared_ptr<Geom3D::Shape>> rightShapes;
-			for (unsigned i = halfShapes; i < shapes.size(); i++)
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (extent[axis] <= 0.0f)
+			{
+				continue;
+			}
+
+			const Geom3D::AABB* binBounds = bins.bounds[axis];
+			const uint32_t* binCounts = bins.counts[axis];
+
+			// sweep from the right to get the cost of the right side of every split plane
+			float rightAreas[SAH_BINS];
+			uint32_t rightCounts[SAH_BINS];
+			Geom3D::AABB rightBounds;
+			uint32_t rightCount = 0;
+			for (int bin = SAH_BINS - 1; bin > 0; bin--)
 			{
-				rightShapes.emplace_back(shapes[i]);
+				rightBounds.Grow(binBounds[bin]);
+				rightCount += binCounts[bin];
+				rightAreas[bin] = rightCount > 0 ? rightBounds.SurfaceArea() : 0.0f;
+				rightCounts[bin] = rightCount;
 			}
-			auto& newRightBHV = std::make_shared<BVH>();
-			newRightBHV->Build(rightShapes);
-			right = newRightBHV;
 
-			break;
+			// sweep from the left evaluating the split after every bin
+			Geom3D::AABB leftBounds;
+			uint32_t leftCount = 0;
+			for (int bin = 0; bin < SAH_BINS - 1; bin++)
+			{
+				leftBounds.Grow(binBounds[bin]);
+				leftCount += binCounts[bin];
+				if (leftCount == 0 || rightCounts[bin + 1] == 0)
+				{
+					continue;
+				}
+
+				float cost = leftBounds.SurfaceArea() * leftCount + rightAreas[bin + 1] * rightCounts[bin + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = bin;
+				}
+			}
 		}
+
+		if (bestAxis < 0)
+		{
+			// all the centroids are at the same position
+			return begin;
 		}
+
+		// compare against the cost of making a leaf
+		float area = aabb.SurfaceArea();
+		float splitCost = SAH_TRAVERSAL_COST + (area > 0.0f ? bestCost / area : 0.0f);
+		if (count <= settings.maxLeafPrimitives && splitCost >= float(count))
+		{
+			return end;
+		}
+
+		// partition the primitives around the best split plane
+		splitAxis = bestAxis;
+		float axisMin = centroidBounds.Min()[bestAxis];
+		float axisBinScale = binScale[bestAxis];
+		auto isLeft = [=](const BuildPrimitive& primitive) { return BinIndex(primitive.centroid[bestAxis], axisMin, axisBinScale) <= bestBin; };
+
+		if (end - begin >= PARALLEL_NODE_MIN_PRIMITIVES)
+		{
+			return StablePartition(buildPrimitives, begin, end, isLeft);
+		}
+
+		auto middle = std::partition(buildPrimitives.begin() + begin, buildPrimitives.begin() + end, isLeft);
+		return (uint32_t)(middle - buildPrimitives.begin());
+	}
+
+	// Stable partition of the primitives in [begin, end), split in chunks across the workers if there are any
+	// Every chunk counts its left primitives, then copies them to its place in the partition buffer and back
+	template<typename Predicate>
+	uint32_t StablePartition(SceneVector<BuildPrimitive>& buildPrimitives, uint32_t begin, uint32_t end, Predicate isLeft)
+	{
+		uint32_t chunksCount = ChunksCount(begin, end);
+
+		ScopedChunkScratch scratch(*chunkScratchList);
+		std::vector<uint32_t>& leftCounts = scratch->leftCounts;
+		leftCounts.assign(chunksCount, 0);
+		ForEachChunk(begin, end, [&](uint32_t chunk, uint32_t chunkBegin, uint32_t chunkEnd)
+		{
+			for (uint32_t i = chunkBegin; i < chunkEnd; i++)
+			{
+				leftCounts[chunk] += isLeft(buildPrimitives[i]) ? 1 : 0;
+			}
+		});
+
+		// first left and right destination of every chunk
+		std::vector<uint32_t>& leftOffsets = scratch->leftOffsets;
+		std::vector<uint32_t>& rightOffsets = scratch->rightOffsets;
+		leftOffsets.resize(chunksCount);
+		rightOffsets.resize(chunksCount);
+		uint32_t leftCount = 0;
+		for (uint32_t chunk = 0; chunk < chunksCount; chunk++)
+		{
+			leftOffsets[chunk] = begin + leftCount;
+			leftCount += leftCounts[chunk];
+		}
+
+		uint32_t middle = begin + leftCount;
+		uint32_t rightCount = 0;
+		for (uint32_t chunk = 0; chunk < chunksCount; chunk++)
+		{
+			uint32_t chunkBegin = ChunkBegin(begin, end, chunk);
+			uint32_t chunkEnd = ChunkBegin(begin, end, chunk + 1);
+			rightOffsets[chunk] = middle + rightCount;
+			rightCount += (chunkEnd - chunkBegin) - leftCounts[chunk];
+		}
+
+		ForEachChunk(begin, end, [&](uint32_t chunk, uint32_t chunkBegin, uint32_t chunkEnd)
+		{
+			uint32_t left = leftOffsets[chunk];
+			uint32_t right = rightOffsets[chunk];
+			for (uint32_t i = chunkBegin; i < chunkEnd; i++)
+			{
+				partitionBuffer[isLeft(buildPrimitives[i]) ? left++ : right++] = buildPrimitives[i];
+			}
+		});
+
+		ForEachChunk(begin, end, [&](uint32_t, uint32_t chunkBegin, uint32_t chunkEnd)
+		{
+			std::copy(partitionBuffer.begin() + chunkBegin, partitionBuffer.begin() + chunkEnd, buildPrimitives.begin() + chunkBegin);
+		});
+
+		return middle;
+	}
+
+	// number of chunks the primitives in [begin, end) are split in
+	uint32_t ChunksCount(uint32_t begin, uint32_t end) const
+	{
+		if (!threadPool || end - begin < PARALLEL_NODE_MIN_PRIMITIVES)
+		{
+			return 1;
+		}
+
+		return threadPool->NumWorkerThreads() + 1;
 	}
 
-	// Shapes Sort function according to AABB min position in X
-	static bool SortFunc(std::shared_ptr<Geom3D::Shape>& shapeA, std::shared_ptr<Geom3D::Shape>& shapeB)
+	// first primitive of a chunk
+	uint32_t ChunkBegin(uint32_t begin, uint32_t end, uint32_t chunk) const
 	{
-		return shapeA->GetAABB().Min().x < shapeB->GetAABB().Min().x;
+		return begin + (uint32_t)((uint64_t)(end - begin) * chunk / ChunksCount(begin, end));
 	}
 
+	// Call function(chunk, chunkBegin, chunkEnd) for every chunk of [begin, end)
+	// The first chunk runs in the calling thread and the rest as tasks
+	template<typename Function>
+	void ForEachChunk(uint32_t begin, uint32_t end, Function function)
+	{
+		uint32_t chunksCount = ChunksCount(begin, end);
+		if (chunksCount == 1)
+		{
+			function(0, begin, end);
+			return;
+		}
+
+		ScopedChunkScratch scratch(*chunkScratchList);
+		std::vector<ThreadTaskResult>& taskResults = scratch->taskResults;
+		taskResults.clear();
+		for (uint32_t chunk = 1; chunk < chunksCount; chunk++)
+		{
+			uint32_t chunkBegin = ChunkBegin(begin, end, chunk);
+			uint32_t chunkEnd = ChunkBegin(begin, end, chunk + 1);
+			taskResults.push_back(threadPool->AddTask([&function, chunk, chunkBegin, chunkEnd]() { function(chunk, chunkBegin, chunkEnd); }));
+		}
+
+		function(0, begin, ChunkBegin(begin, end, 1));
+
+		for (auto& taskResult : taskResults)
+		{
+			threadPool->WaitForTask(taskResult);
+		}
+	}
+
+	// SAH bin of a centroid coordinate
+	static int BinIndex(float value, float axisMin, float binScale)
+	{
+		return std::min(int((value - axisMin) * binScale), SAH_BINS - 1);
+	}
 };
 
 #endif // !BVH_H
-
@@ -1,34 +1,30 @@
 #ifndef RAYTRACER_H
 #define RAYTRACER_H
 
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
 #include <chrono>
-#include <random>
+#include <functional>
 #include <sstream>
 
-#include "../ThreadPool/ThreadPool.h"
+#include "glm/glm.hpp"
+
+#include "../ThreadPool/WorkStealingThreadPool.h"
 
 #include "../Geom3D/Geom3D.h"
 
 #include "Camera/Camera.h"
 #include "Materials/MaterialFactory.h"
+#include "Sampler/Sampler.h"
 
 #define PROFILE_HIT_TEST 0
 #include "../World/World.h"
+#include "../World/SceneGenerator.h"
+#include "../World/SceneLoader.h"
 
 typedef std::chrono::time_point<std::chrono::system_clock> TimePoint;
 
-// random number generation
-std::random_device randomDevice;
-std::mt19937 randomEngine(randomDevice());
-std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
-
-std::uniform_real_distribution<float> spherePositionXDistribution(-2.0f, 2.0f);
-std::uniform_real_distribution<float> spherePositionYDistribution(-1.0f, 0.0f);
-std::uniform_real_distribution<float> spherePositionZDistribution(-10.0f, 5.0f);
-std::uniform_real_distribution<float> sphereRadiusDistribution(0.01f, 0.1f);
-std::uniform_real_distribution<float> materialAttenuationDistribution(0.0f, 1.0f);
-std::uniform_int_distribution<int>  materialTypeDistribution(0, 4);
-
 enum class RaytracerState
 {
 	IDLE,
@@ -45,10 +41,57 @@ struct RaytracerConfiguration
   int antialiasingSamplesCount = 1;
 	int maxRecursionDepth = 1;
 	int renderingSubtasksCount = 1;
+	int tileSize = 32;
 	bool useBVH = false;
+	BVHSplitMethod bvhSplitMethod = BVHSplitMethod::SAH;
+	int bvhMaxLeafPrimitives = 4;
+	int bvhWidth = 2;
+	int samplerSeed = 0;
+	bool progressive = false;
+	int samplesPerPass = 1;
+	bool adaptiveSampling = false;
+	int adaptiveMinSamples = 4;
+	int adaptiveMaxSamples = 64;
+	float adaptiveErrorThreshold = 0.05f;
+	bool russianRoulette = true;
+	int russianRouletteMinDepth = 3;
+	bool wavefront = false;
+	bool rayPackets = false;
 	
   int randomShapes = 0;
+  int sceneSeed = 0;
   std::string sceneId;
+
+  // snapshot to load the scene and its BVH from instead of creating it, and snapshot to save the created scene to
+  std::string sceneSnapshot;
+  std::string saveSceneSnapshot;
+};
+
+// state of a path traced in wavefront mode
+struct WavefrontPath
+{
+	Geom3D::Ray ray;
+	glm::vec3 throughput;
+	Sampler sampler;
+
+	// index of the pixel sample the path contributes to
+	unsigned sampleSlot;
+};
+
+// per thread queues used in wavefront mode. Kept between chunks so their memory is reused
+struct WavefrontQueues
+{
+	// paths of the current and the next bounce
+	std::vector<WavefrontPath> paths;
+	std::vector<WavefrontPath> nextPaths;
+
+	// hit of every path in the current bounce and indices of the paths that hit something, grouped by material type
+	std::vector<Geom3D::RaycastHit> hits;
+	std::vector<unsigned> hitPaths;
+
+	// colour and pixel index of every pixel sample in the chunk
+	std::vector<glm::vec3> sampleColours;
+	std::vector<unsigned> samplePixels;
 };
 
 class Raytracer
@@ -63,12 +106,51 @@ class Raytracer
 	// max recursion depth
 	int maxRecursionDepth = 1;
 
+	// russian roulette: from russianRouletteMinDepth on, paths survive each bounce with a probability that
+	// follows their throughput and survivors are reweighted, so low contribution paths end early without bias
+	bool russianRoulette = true;
+	int russianRouletteMinDepth = 3;
+
+	// wavefront mode: paths of a whole tile advance one bounce at a time. Every bounce intersects all the rays,
+	// shades the hits grouped by material type and compacts the surviving paths into the next bounce queue
+	bool wavefront = false;
+
+	// ray packets: coherent rays are raycast together so every BVH node and sphere fetched is tested against all of them.
+	// Used for the camera rays of a pixel and, in wavefront mode, for the camera rays and metal reflections of a tile
+	bool rayPackets = false;
+
+	// seed of the pixel samplers
+	int samplerSeed = 0;
+
 	// use Bounding Volume Hierarchy optimisation
 	bool useBVH = false;
+	BVHBuildSettings bvhBuildSettings;
 
 	// pixels buffer
 	float* buffer = nullptr;
 
+	// progressive rendering: every pass adds samplesPerPass samples to each pixel and updates the pixels buffer
+	bool progressive = false;
+	int samplesPerPass = 1;
+
+	// adaptive sampling: once a pixel has adaptiveMinSamples it only keeps sampling, up to adaptiveMaxSamples,
+	// while the standard error of its luminance relative to its mean is above adaptiveErrorThreshold
+	bool adaptiveSampling = false;
+	int adaptiveMinSamples = 4;
+	int adaptiveMaxSamples = 64;
+	float adaptiveErrorThreshold = 0.05f;
+
+	// samples added to the pixels that have not converged on every adaptive sampling round in wavefront mode
+	static const int WAVEFRONT_ADAPTIVE_ROUND_SAMPLES = 4;
+
+	// pixels stop sampling at this sample index on the current pass
+	int passEndSample = 1;
+
+	// accumulated colour, squared luminance and samples count of every pixel
+	std::vector<glm::vec3> accumulationBuffer;
+	std::vector<float> luminanceSquaredBuffer;
+	std::vector<int> pixelSamplesCount;
+
 	// raytracer state
 	RaytracerState state = RaytracerState::IDLE;
 
@@ -76,10 +158,20 @@ class Raytracer
 	TimePoint renderStart;
 	std::string renderTimeStr;
 
+	// scene loading times
+	std::string sceneCreationTimeStr;
+	std::string bvhBuildTimeStr;
+
 	// threadpool
-	ThreadPool threadPool;
+	WorkStealingThreadPool threadPool;
 	int renderingSubtasksCount = 1;
 
+	// tiles the image is split into. Render tasks keep picking the next tile until none is left
+	int tileSize = 32;
+	int tilesCountX = 0;
+	int tilesCountY = 0;
+	std::atomic<int> nextTile;
+
 	// camera
 	Camera camera;
 
@@ -101,8 +193,28 @@ public:
   // setters
   void SetAntialiasingSamplesCount(unsigned count) { antialiasingSamplesCount = count; }
   void SetMaxRecursionDepth(unsigned depth) { maxRecursionDepth = depth; }
+  void SetRussianRoulette(bool enable, unsigned minDepth) { russianRoulette = enable; russianRouletteMinDepth = minDepth; }
+  void SetWavefront(bool enable) { wavefront = enable; }
+  void SetRayPackets(bool enable) { rayPackets = enable; }
   void SetRenderingSubtasksCount(unsigned count) { renderingSubtasksCount = count; }
+  void SetTileSize(unsigned size) { tileSize = size > 0 ? size : 1; }
   void SetUseBVH(bool use) { useBVH = use; }
+  void SetBVHBuildSettings(BVHSplitMethod splitMethod, unsigned maxLeafPrimitives, unsigned width)
+  {
+    bvhBuildSettings.splitMethod = splitMethod;
+    bvhBuildSettings.maxLeafPrimitives = maxLeafPrimitives > 0 ? maxLeafPrimitives : 1;
+    bvhBuildSettings.width = (width == 4 || width == 8) ? width : 2;
+  }
+  void SetSamplerSeed(int seed) { samplerSeed = seed; }
+  void SetProgressive(bool enable) { progressive = enable; }
+  void SetSamplesPerPass(int count) { samplesPerPass = std::max(count, 1); }
+  void SetAdaptiveSampling(bool enable, int minSamples, int maxSamples, float errorThreshold)
+  {
+    adaptiveSampling = enable;
+    adaptiveMinSamples = std::max(minSamples, 1);
+    adaptiveMaxSamples = std::max(maxSamples, adaptiveMinSamples);
+    adaptiveErrorThreshold = errorThreshold;
+  }
 
 	// init
 	void Init(const RaytracerConfiguration& config)
@@ -113,12 +225,21 @@ public:
 
     SetAntialiasingSamplesCount(config.antialiasingSamplesCount);
     SetMaxRecursionDepth(config.maxRecursionDepth);
+    SetRussianRoulette(config.russianRoulette, config.russianRouletteMinDepth);
+    SetWavefront(config.wavefront);
+    SetRayPackets(config.rayPackets);
     SetRenderingSubtasksCount(config.renderingSubtasksCount);
+    SetTileSize(config.tileSize);
     SetUseBVH(config.useBVH);
-
-    InitCamera();
+    SetBVHBuildSettings(config.bvhSplitMethod, config.bvhMaxLeafPrimitives, config.bvhWidth);
+    SetSamplerSeed(config.samplerSeed);
+    SetProgressive(config.progressive);
+    SetSamplesPerPass(config.samplesPerPass);
+    SetAdaptiveSampling(config.adaptiveSampling, config.adaptiveMinSamples, config.adaptiveMaxSamples, config.adaptiveErrorThreshold);
 
 		LoadScene(config);
+
+    InitCamera();
 	}
 
 	// start rendering
@@ -154,55 +275,117 @@ public:
 		printf("Rendering...\n");
 
 		renderStart = std::chrono::system_clock::now();
+
+		// start accumulating from scratch
+		accumulationBuffer.assign(width * height, glm::vec3(0.0f, 0.0f, 0.0f));
+		luminanceSquaredBuffer.assign(width * height, 0.0f);
+		pixelSamplesCount.assign(width * height, 0);
+
+		// with adaptive sampling the antialiasing samples count is replaced by the adaptive max samples
+		int samplesCount = adaptiveSampling ? adaptiveMaxSamples : antialiasingSamplesCount;
+
+		// without progressive rendering all the samples are taken in a single pass
+		int maxPassSamplesCount = progressive ? samplesPerPass : samplesCount;
+		int passSamplesCount = 0;
+		for (int samples = 0; samples < samplesCount; samples += passSamplesCount)
+		{
+			passSamplesCount = std::min(maxPassSamplesCount, samplesCount - samples);
+			passEndSample = samples + passSamplesCount;
+
+			RenderPass();
+
+			if (state == RaytracerState::RENDERING_CANCELLED)
+			{
+				break;
+			}
+
+			if (progressive)
+			{
+				std::string passTimeStr = GetTimeStr(renderStart, std::chrono::system_clock::now());
+				printf("Pass DONE: %d samples per pixel. %s\n", samples + passSamplesCount, passTimeStr.c_str());
+			}
+		}
+		
+		// notify render ended
+		bool cancelled = (state == RaytracerState::RENDERING_CANCELLED);
+		OnRenderingEnded(cancelled);
+	}
+
+protected:
+	Raytracer() : state(RaytracerState::IDLE) {}
+	~Raytracer() {};
+
+	// render pass
+	void RenderPass()
+	{
+		// split the image in tiles
+		tilesCountX = (width + tileSize - 1) / tileSize;
+		tilesCountY = (height + tileSize - 1) / tileSize;
+		nextTile = 0;
 		
 		if (renderingSubtasksCount > 1)
 		{
-			// Split rendering by adding as many render tasks as renderingSubtasksCount
-			// Each thread will be responsible for doing a render chunk
+			// Add as many render tasks as renderingSubtasksCount
+			// Each task keeps picking tiles until all of them are rendered, so the load balances by itself
 			std::vector<ThreadTaskResult> taskResults;
 
-			int heightInterval = height / renderingSubtasksCount;
 			for (int i = 0; i < renderingSubtasksCount; i++)
 			{
-				int startHeight = height - (i * heightInterval);
-				int endHeight = (i == renderingSubtasksCount - 1) ? 0 : startHeight - heightInterval;
-
-				auto task = std::bind(&Raytracer::RenderChunk, this, startHeight, endHeight);
+				auto task = std::bind(&Raytracer::RenderTiles, this);
 				auto taskResult = threadPool.AddTask(task);
 
 				taskResults.push_back(std::move(taskResult));
 			}
 
 			// make current thread to wait until all render tasks has been completed
-			void* result = nullptr;
 			for (size_t i = 0; i < taskResults.size(); i++)
 			{
-				taskResults[i].WaitForResult(result);
+				threadPool.WaitForTask(taskResults[i]);
 			}
 		}
 		else
 		{
-			RenderChunk(height, 0);
+			RenderTiles();
 		}
-		
-		// notify render ended
-		bool cancelled = (state == RaytracerState::RENDERING_CANCELLED);
-		OnRenderingEnded(cancelled);
 	}
 
-protected:
-	Raytracer() : state(RaytracerState::IDLE) {}
-	~Raytracer() {};
-
 	// internal render
-	void RenderChunk(int startHeight, int endHeight)
+	void RenderTiles()
+	{
+		int tilesCount = tilesCountX * tilesCountY;
+		for (int tile = nextTile++; tile < tilesCount; tile = nextTile++)
+		{
+			// tiles are picked from the top of the image
+			int startX = (tile % tilesCountX) * tileSize;
+			int endX = std::min(startX + tileSize, width);
+			int startHeight = height - (tile / tilesCountX) * tileSize;
+			int endHeight = std::max(startHeight - tileSize, 0);
+
+			if (wavefront)
+			{
+				RenderChunkWavefront(startX, endX, startHeight, endHeight);
+			}
+			else
+			{
+				RenderChunk(startX, endX, startHeight, endHeight);
+			}
+
+			if (state == RaytracerState::RENDERING_CANCELLED)
+			{
+				return;
+			}
+		}
+	}
+
+	// render a rectangle of pixels
+	void RenderChunk(int startX, int endX, int startHeight, int endHeight)
 	{
 		for (int y = startHeight - 1; y >= endHeight; y--)
 		{
-			for (int x = 0; x < width; x++)
+			for (int x = startX; x < endX; x++)
 			{
 				//calculate pixel colour
-				glm::vec4 pixelColour = CalculatePixelColour(x, y, camera);
+				glm::vec4 pixelColour = AccumulatePixelColour(x, y, camera);
 
 				// set pixel colour
 				SetPixelColour(x, y, pixelColour);
@@ -218,65 +401,395 @@ protected:
 		}
 	}
 
-  // calculate pixel colour
-  inline glm::vec4 CalculatePixelColour(int x, int y, Camera& camera)
+	// render a rectangle of pixels breadth first
+	// Note: with adaptive sampling the samples are taken in rounds and convergence is checked between them. Pixels first
+	// get up to adaptiveMinSamples, then WAVEFRONT_ADAPTIVE_ROUND_SAMPLES more per round until they converge
+	void RenderChunkWavefront(int startX, int endX, int startHeight, int endHeight)
+	{
+		thread_local WavefrontQueues queues;
+
+		while (GenerateWavefrontPaths(queues, startX, endX, startHeight, endHeight))
+		{
+			// check for rendering cancelled. The round is dropped so its pixels keep their previous samples
+			if (!TraceWavefrontPaths(queues))
+			{
+				return;
+			}
+
+			// accumulate the pixel samples
+			for (size_t i = 0; i < queues.sampleColours.size(); i++)
+			{
+				unsigned pixelIndex = queues.samplePixels[i];
+				const glm::vec3& sampleColour = queues.sampleColours[i];
+				float sampleLuminance = Luminance(sampleColour);
+
+				accumulationBuffer[pixelIndex] += sampleColour;
+				luminanceSquaredBuffer[pixelIndex] += sampleLuminance * sampleLuminance;
+				pixelSamplesCount[pixelIndex]++;
+			}
+
+			// without adaptive sampling all the pass samples are taken in a single round
+			if (!adaptiveSampling)
+			{
+				break;
+			}
+		}
+
+		// set pixels colour
+		for (int y = startHeight - 1; y >= endHeight; y--)
+		{
+			for (int x = startX; x < endX; x++)
+			{
+				unsigned pixelIndex = y*width + x;
+				SetPixelColour(x, y, glm::vec4(accumulationBuffer[pixelIndex] / float(pixelSamplesCount[pixelIndex]), 1.0f));
+			}
+		}
+	}
+
+	// generate the camera rays of the next round of pixel samples in the chunk. Returns false if there are none
+	bool GenerateWavefrontPaths(WavefrontQueues& queues, int startX, int endX, int startHeight, int endHeight)
+	{
+		queues.paths.clear();
+		queues.sampleColours.clear();
+		queues.samplePixels.clear();
+
+		for (int y = startHeight - 1; y >= endHeight; y--)
+		{
+			for (int x = startX; x < endX; x++)
+			{
+				unsigned pixelIndex = y*width + x;
+				int firstSample = pixelSamplesCount[pixelIndex];
+				int endSample = passEndSample;
+
+				if (adaptiveSampling)
+				{
+					if (firstSample >= adaptiveMinSamples && IsPixelConverged(pixelIndex, firstSample))
+					{
+						continue;
+					}
+
+					endSample = std::min(endSample, firstSample < adaptiveMinSamples ? adaptiveMinSamples : firstSample + WAVEFRONT_ADAPTIVE_ROUND_SAMPLES);
+				}
+
+				for (int sample = firstSample; sample < endSample; sample++)
+				{
+					Sampler sampler(samplerSeed, pixelIndex, sample);
+
+					glm::vec2 offset = sampler.Next2D();
+					float u = (float(x) + offset.x) / float(width);
+					float v = (float(y) + offset.y) / float(height);
+
+					WavefrontPath path = { camera.GetRay(u, v), glm::vec3(1.0f, 1.0f, 1.0f), sampler, (unsigned)queues.sampleColours.size() };
+					queues.paths.push_back(path);
+					queues.sampleColours.push_back(glm::vec3(0.0f, 0.0f, 0.0f));
+					queues.samplePixels.push_back(pixelIndex);
+				}
+			}
+		}
+
+		return !queues.paths.empty();
+	}
+
+	// trace the paths bounce by bounce until all of them end, writing their colours to the sample slots
+	// Returns false if the rendering gets cancelled
+	bool TraceWavefrontPaths(WavefrontQueues& queues)
+	{
+		const MaterialTable& materials = world.Materials();
+
+		// range of coherent paths: camera rays and, after the first bounce, metal reflections
+		size_t coherentPathsBegin = 0;
+		size_t coherentPathsEnd = queues.paths.size();
+
+		for (int recursionDepth = 0; !queues.paths.empty(); recursionDepth++)
+		{
+			size_t pathsCount = queues.paths.size();
+			queues.hits.resize(pathsCount);
+
+			float minDistance = recursionDepth > 0 ? 0.001f : 0.0f;
+
+			// intersect the whole batch, coherent paths in packets. Paths that miss get the background colour
+			size_t typeOffsets[(int)MaterialType::COUNT + 1] = {};
+			for (size_t i = 0; i < pathsCount; )
+			{
+				int hitMask = 0;
+				size_t count = 1;
+				if (rayPackets && i >= coherentPathsBegin && i + 1 < coherentPathsEnd)
+				{
+					count = std::min(coherentPathsEnd - i, (size_t)Geom3D::RayPacket::SIZE);
+
+					Geom3D::RayPacket packet;
+					for (size_t j = 0; j < count; j++)
+					{
+						packet.Add(queues.paths[i + j].ray);
+					}
+
+					hitMask = RaycastPacket(packet, minDistance, &queues.hits[i]);
+				}
+				else
+				{
+					queues.hits[i].hitDistance = FLT_MAX;
+					hitMask = Raycast(queues.paths[i].ray, minDistance, FLT_MAX, queues.hits[i]) ? 1 : 0;
+				}
+
+				for (size_t j = 0; j < count; j++, i++)
+				{
+					WavefrontPath& path = queues.paths[i];
+					Geom3D::RaycastHit& raycastHit = queues.hits[i];
+
+					if ((hitMask & (1 << j)) != 0)
+					{
+						typeOffsets[(int)materials[raycastHit.hitMaterialId].Type() + 1]++;
+					}
+					else
+					{
+						raycastHit.hitMaterialId = NO_MATERIAL;
+						queues.sampleColours[path.sampleSlot] = path.throughput * GetBackgroundColour(path.ray);
+					}
+				}
+			}
+
+			// group the hits by material type
+			for (int type = 0; type < (int)MaterialType::COUNT; type++)
+			{
+				typeOffsets[type + 1] += typeOffsets[type];
+			}
+
+			queues.hitPaths.resize(typeOffsets[(int)MaterialType::COUNT]);
+			for (size_t i = 0; i < pathsCount; i++)
+			{
+				MaterialId materialId = queues.hits[i].hitMaterialId;
+				if (materialId != NO_MATERIAL)
+				{
+					queues.hitPaths[typeOffsets[(int)materials[materialId].Type()]++] = (unsigned)i;
+				}
+			}
+
+			// scatter the hits and compact the surviving paths into the next bounce queue
+			// Paths reaching the max recursion depth are absorbed
+			// Note: after the counting sort typeOffsets[type] is where the paths of the next type start, so the metal
+			// reflections, which stay coherent, end up together in the next bounce queue
+			queues.nextPaths.clear();
+			size_t metalPathsBegin = (int)MaterialType::METAL > 0 ? typeOffsets[(int)MaterialType::METAL - 1] : 0;
+			size_t metalPathsEnd = typeOffsets[(int)MaterialType::METAL];
+			bool hasMetalPaths = metalPathsBegin < metalPathsEnd;
+			coherentPathsBegin = 0;
+			coherentPathsEnd = 0;
+			if (recursionDepth < maxRecursionDepth)
+			{
+				for (size_t k = 0; k < queues.hitPaths.size(); k++)
+				{
+					if (hasMetalPaths && k == metalPathsBegin)
+					{
+						coherentPathsBegin = queues.nextPaths.size();
+					}
+
+					if (hasMetalPaths && k == metalPathsEnd)
+					{
+						coherentPathsEnd = queues.nextPaths.size();
+					}
+
+					unsigned pathIndex = queues.hitPaths[k];
+					WavefrontPath& path = queues.paths[pathIndex];
+
+					glm::vec3 attenuation;
+					if (!materials[queues.hits[pathIndex].hitMaterialId].ScatterRay(path.ray, queues.hits[pathIndex], path.sampler, attenuation, path.ray))
+					{
+						continue;
+					}
+
+					path.throughput *= attenuation;
+					if (!RussianRoulette(recursionDepth, path.throughput, path.sampler))
+					{
+						continue;
+					}
+
+					queues.nextPaths.push_back(path);
+				}
+
+				if (hasMetalPaths && metalPathsEnd == queues.hitPaths.size())
+				{
+					coherentPathsEnd = queues.nextPaths.size();
+				}
+			}
+
+			std::swap(queues.paths, queues.nextPaths);
+
+			// check for rendering cancelled
+			if (state == RaytracerState::RENDERING_CANCELLED)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+  // add the current pass samples to the pixel and return its average colour
+  inline glm::vec4 AccumulatePixelColour(int x, int y, Camera& camera)
   {
     // Note: we send more than one ray per pixel (randomly offset) in order to do antialiasing
 
-    glm::vec3 pixelColour(0.0f, 0.0f, 0.0f);
-    for (int sample = 0; sample < antialiasingSamplesCount; sample++)
-    {
-      // ray generation
-      float xOffset = distribution(randomEngine);
-      float yOffset = distribution(randomEngine);
-      float u = (float(x) + xOffset) / float(width);
-      float v = (float(y) + yOffset) / float(height);
+    unsigned pixelIndex = y*width + x;
 
-      Geom3D::Ray ray = camera.GetRay(u, v);
+    Sampler samplers[Geom3D::RayPacket::SIZE];
+    Geom3D::RayPacket packet;
+    Geom3D::RaycastHit raycastHits[Geom3D::RayPacket::SIZE];
 
-			// calculate pixel colour for the following ray
-			pixelColour += CalculatePixelColour(ray, 0);
+    int sample = pixelSamplesCount[pixelIndex];
+    while (sample < passEndSample)
+    {
+      // stop sampling once the pixel has converged
+      if (adaptiveSampling && sample >= adaptiveMinSamples && IsPixelConverged(pixelIndex, sample))
+      {
+        break;
+      }
+
+      // samples traced together. Adaptive sampling still checks convergence after every sample past its min samples
+      int batchEnd = sample + 1;
+      if (rayPackets)
+      {
+        batchEnd = std::min(passEndSample, sample + Geom3D::RayPacket::SIZE);
+        if (adaptiveSampling)
+        {
+          batchEnd = std::min(batchEnd, std::max(adaptiveMinSamples, sample + 1));
+        }
+      }
+
+      // ray generation. Every pixel sample has its own random numbers stream
+      packet.Clear();
+      for (int i = 0; i < batchEnd - sample; i++)
+      {
+        samplers[i] = Sampler(samplerSeed, pixelIndex, sample + i);
+
+        glm::vec2 offset = samplers[i].Next2D();
+        float u = (float(x) + offset.x) / float(width);
+        float v = (float(y) + offset.y) / float(height);
+
+        packet.Add(camera.GetRay(u, v));
+      }
+
+      int hitMask = 0;
+      if (packet.count > 1)
+      {
+        hitMask = RaycastPacket(packet, 0.0f, raycastHits);
+      }
+      else
+      {
+        raycastHits[0].hitDistance = FLT_MAX;
+        hitMask = Raycast(packet.rays[0], 0.0f, FLT_MAX, raycastHits[0]) ? 1 : 0;
+      }
+
+      for (int i = 0; i < packet.count; i++)
+      {
+        // calculate pixel colour for the following ray and accumulate it
+        glm::vec3 sampleColour = CalculatePixelColour(packet.rays[i], (hitMask & (1 << i)) != 0, raycastHits[i], samplers[i]);
+        float sampleLuminance = Luminance(sampleColour);
+
+        accumulationBuffer[pixelIndex] += sampleColour;
+        luminanceSquaredBuffer[pixelIndex] += sampleLuminance * sampleLuminance;
+      }
+
+      sample = batchEnd;
 		}
 
-    // avarage the colour
-    pixelColour /= float(antialiasingSamplesCount);
+    pixelSamplesCount[pixelIndex] = sample;
 
-    return glm::vec4(pixelColour, 1.0f);
+    // avarage the colour
+    return glm::vec4(accumulationBuffer[pixelIndex] / float(sample), 1.0f);
   }
 
-	// calculate pixel colour
-	glm::vec3 CalculatePixelColour(const Geom3D::Ray& ray, int recursionDepth)
+	// check if the error estimate of the pixel is below the adaptive error threshold
+	bool IsPixelConverged(unsigned pixelIndex, int samplesCount) const
+	{
+		if (samplesCount < 2)
+		{
+			return false;
+		}
+
+		// sample variance of the luminance
+		float n = float(samplesCount);
+		float mean = Luminance(accumulationBuffer[pixelIndex]) / n;
+		float variance = std::max(luminanceSquaredBuffer[pixelIndex] / n - mean * mean, 0.0f) * n / (n - 1.0f);
+
+		// standard error of the mean relative to the mean. The floor avoids chasing noise on almost black pixels
+		float standardError = sqrtf(variance / n);
+		return standardError <= adaptiveErrorThreshold * std::max(mean, 0.01f);
+	}
+
+	// luminance of a linear colour
+	static float Luminance(const glm::vec3& colour)
 	{
-		// raycast
-		Geom3D::RaycastHit raycastHit;
-		if (Raycast(ray, recursionDepth > 0 ? 0.001f: 0.0f, FLT_MAX, raycastHit))
+		return glm::dot(colour, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+	}
+
+	// calculate pixel colour given the raycast of the camera ray
+	glm::vec3 CalculatePixelColour(const Geom3D::Ray& cameraRay, bool hit, Geom3D::RaycastHit& raycastHit, Sampler& sampler)
+	{
+		// follow the path bounce by bounce carrying the attenuation accumulated so far
+		glm::vec3 throughput(1.0f, 1.0f, 1.0f);
+		Geom3D::Ray ray = cameraRay;
+
+		for (int recursionDepth = 0; ; recursionDepth++)
 		{
-			// recursively scatter the ray
+			// raycast
+			if (recursionDepth > 0)
+			{
+				raycastHit.hitDistance = FLT_MAX;
+				hit = Raycast(ray, 0.001f, FLT_MAX, raycastHit);
+			}
+
+			if (!hit)
+			{
+				return throughput * GetBackgroundColour(ray);
+			}
+
+			// scatter the ray
 			glm::vec3 attenuation;
-			Geom3D::Ray scatteredRay;
-			if (recursionDepth < maxRecursionDepth && raycastHit.hitMaterial->ScatterRay(raycastHit, attenuation, scatteredRay))
+			if (recursionDepth >= maxRecursionDepth || !world.Materials()[raycastHit.hitMaterialId].ScatterRay(ray, raycastHit, sampler, attenuation, ray))
 			{
-				return attenuation * CalculatePixelColour(scatteredRay, recursionDepth + 1);
+				return glm::vec3(0.0f, 0.0f, 0.0f);
 			}
-			else
+
+			throughput *= attenuation;
+			if (!RussianRoulette(recursionDepth, throughput, sampler))
 			{
 				return glm::vec3(0.0f, 0.0f, 0.0f);
 			}
 		}
+	}
+
+	// russian roulette. Returns false if the path is terminated, otherwise reweights its throughput
+	inline bool RussianRoulette(int recursionDepth, glm::vec3& throughput, Sampler& sampler)
+	{
+		if (russianRoulette && recursionDepth + 1 >= russianRouletteMinDepth)
+		{
+			float survivalProbability = std::min(std::max(throughput.r, std::max(throughput.g, throughput.b)), 1.0f);
+			if (sampler.Next1D() >= survivalProbability)
+			{
+				return false;
+			}
 
-		return GetBackgroundColour(ray);
+			throughput /= survivalProbability;
+		}
+
+		return true;
 	}
 
 	// raycast
 	bool Raycast(const Geom3D::Ray& ray, float minDistance, float maxDistance, Geom3D::RaycastHit& raycastHit)
 	{
-		bool raycast = world.Raycast(ray, minDistance, maxDistance, raycastHit);
-    if (raycast)
-    {
-      raycastHit.ray = ray;
-    }
-   
-		return raycast;
+		return world.Raycast(ray, minDistance, maxDistance, raycastHit);
+	}
+
+	// raycast a packet of rays. Returns a bit per ray that hits something
+	int RaycastPacket(const Geom3D::RayPacket& packet, float minDistance, Geom3D::RaycastHit* raycastHits)
+	{
+		for (int i = 0; i < packet.count; i++)
+		{
+			raycastHits[i].hitDistance = FLT_MAX;
+		}
+
+		return world.RaycastPacket(packet, minDistance, FLT_MAX, raycastHits);
 	}
 
 	// get background colour
@@ -307,83 +820,115 @@ private:
     // clear current world
     world.Clear();
 
+    // a snapshot already holds the scene and its BVH
+		bvhBuildTimeStr.clear();
+		if (!config.sceneSnapshot.empty())
+		{
+			TimePoint snapshotStart = std::chrono::system_clock::now();
+			if (world.LoadSnapshot(config.sceneSnapshot.c_str()))
+			{
+				sceneCreationTimeStr = GetTimeStr(snapshotStart, std::chrono::system_clock::now()) + " (snapshot)";
+
+				// the BVH flags win over the BVH saved in the snapshot
+				if (!useBVH)
+				{
+					world.ClearBVH();
+				}
+				else if (!world.UsesBVH() || world.BVHWidth() != bvhBuildSettings.width)
+				{
+					printf("Snapshot BVH does not match the BVH settings, rebuilding it\n");
+					TimePoint bvhStart = std::chrono::system_clock::now();
+					world.BuildBVH(bvhBuildSettings, &threadPool);
+					bvhBuildTimeStr = GetTimeStr(bvhStart, std::chrono::system_clock::now());
+				}
+
+				return;
+			}
+
+			fprintf(stderr, "Unable to load scene snapshot: %s. Creating the scene instead\n", config.sceneSnapshot.c_str());
+		}
+
     // load the scene defined or a random one
-    config.sceneId.empty() ? CreateRandomScene(config.randomShapes) : LoadScene(config.sceneId);
+    TimePoint sceneStart = std::chrono::system_clock::now();
+    if (config.sceneId.empty() || !LoadScene(config.sceneId))
+    {
+      CreateRandomScene(config.randomShapes, config.sceneSeed);
+    }
+    sceneCreationTimeStr = GetTimeStr(sceneStart, std::chrono::system_clock::now());
 
-    // build BVH
+    // build BVH on the thread pool
 		if (useBVH)
 		{
-			world.BuildBVH();
+			TimePoint bvhStart = std::chrono::system_clock::now();
+			world.BuildBVH(bvhBuildSettings, &threadPool);
+			bvhBuildTimeStr = GetTimeStr(bvhStart, std::chrono::system_clock::now());
+		}
+
+		if (!config.saveSceneSnapshot.empty() && !world.SaveSnapshot(config.saveSceneSnapshot.c_str()))
+		{
+			fprintf(stderr, "Unable to save scene snapshot: %s\n", config.saveSceneSnapshot.c_str());
 		}
 	}
 
-  void LoadScene(const std::string& sceneId)
+  // Load a scene file. The id is either the path of the file or the name of a scene in config/scenes
+  bool LoadScene(const std::string& sceneId)
   {
-    // TO-DO
+    std::string path = sceneId.find_first_of("/\\.") == std::string::npos ? "config/scenes/" + sceneId + ".scene" : sceneId;
 
-    MaterialFactoryParams materialParams;
-    materialParams.materialType = "Diffuse";
-    materialParams.materialColour = glm::vec3(0.8f, 0.3f, 0.4f);
-    std::shared_ptr<Material> material = MaterialFactory::Create(materialParams);
+    TimePoint loadStart = std::chrono::system_clock::now();
+    if (!SceneLoader::Load(path.c_str(), world))
+    {
+      fprintf(stderr, "Unable to load scene %s. Creating a random scene instead\n", sceneId.c_str());
+      world.Clear();
+      return false;
+    }
 
-    Geom3D::ShapeFactoryParams shapeParams;
-    shapeParams.shapeType = "Sphere";
-    shapeParams.shapePos = glm::vec3(-0.5f, 0.0f, -1.3f);
-    shapeParams.radius = 0.5f;
-    shapeParams.material = material;
-    std::shared_ptr<Geom3D::Shape> shape = Geom3D::ShapeFactory::Create(shapeParams);
-    
-    world.AddShape(shape);
+    // loading throughput
+    double seconds = std::chrono::duration<double>(std::chrono::system_clock::now() - loadStart).count();
+    uint32_t shapesCount = world.Shapes().Size();
+    printf("Scene %s: %u shapes and %u materials loaded (%.0f shapes/s)\n", path.c_str(), shapesCount, world.Materials().Size(),
+      seconds > 0.0 ? shapesCount / seconds : 0.0);
+    return true;
   }
 
-  // create random scene
-	void CreateRandomScene(int randomShapes)
+  // create random scene. The same seed always creates the same scene
+	void CreateRandomScene(int randomShapes, int seed)
 	{
     // two big spheres
-    world.AddShape(CreateSphere(glm::vec3(-0.5f, 0.0f, -1.3f), 0.5f, "Diffuse", glm::vec3(0.8f, 0.3f, 0.4f)));
-    world.AddShape(CreateSphere(glm::vec3(0.7f, 0.0f, -3.0f), 0.5f, "Metal", glm::vec3(0.8f, 0.6f, 0.2f)));
+    CreateSphere(glm::vec3(-0.5f, 0.0f, -1.3f), 0.5f, "Diffuse", glm::vec3(0.8f, 0.3f, 0.4f));
+    CreateSphere(glm::vec3(0.7f, 0.0f, -3.0f), 0.5f, "Metal", glm::vec3(0.8f, 0.6f, 0.2f));
 
     // floor 
-    world.AddShape(CreateSphere(glm::vec3(0.0f, -100.5f, -1.0f), 100.0f, "Diffuse", glm::vec3(0.8f, 0.8f, 0.8f)));
+    CreateSphere(glm::vec3(0.0f, -100.5f, -1.0f), 100.0f, "Diffuse", glm::vec3(0.8f, 0.8f, 0.8f));
 
-		// random shapes
-		for (int i = 0; i < randomShapes; i++)
-		{
-			// random material
-			glm::vec3 attenuation(materialAttenuationDistribution(randomEngine), materialAttenuationDistribution(randomEngine), materialAttenuationDistribution(randomEngine));
-			bool diffuseMaterial = materialTypeDistribution(randomEngine) > 0;
-			
-			// random sphere
-			glm::vec3 spherePos(spherePositionXDistribution(randomEngine), spherePositionYDistribution(randomEngine), spherePositionZDistribution(randomEngine));
-			float sphereRadius = sphereRadiusDistribution(randomEngine);
-
-      world.AddShape(CreateSphere(spherePos, sphereRadius, diffuseMaterial ? "Diffuse" : "Metal", attenuation));
-		}
+		// random shapes, generated on the thread pool
+		SceneGenerator::Generate(world, (uint32_t)std::max(randomShapes, 0), (uint32_t)seed, &threadPool);
 	}
 
-  std::shared_ptr<Geom3D::Shape> CreateSphere(const glm::vec3& pos, float radius, const std::string& materialType, const glm::vec3& materialColour)
+  // create a sphere with its material and add it to the world
+  Geom3D::ShapeRef CreateSphere(const glm::vec3& pos, float radius, const std::string& materialType, const glm::vec3& materialColour)
   {
     MaterialFactoryParams materialParams;
     materialParams.materialType = materialType;
     materialParams.materialColour = materialColour;
-    std::shared_ptr<Material> material = MaterialFactory::Create(materialParams);
+    MaterialId materialId = world.AddMaterial(MaterialFactory::Create(materialParams));
 
     Geom3D::ShapeFactoryParams shapeParams;
     shapeParams.shapeType = "Sphere";
     shapeParams.shapePos = pos;
     shapeParams.radius = radius;
-    shapeParams.material = material;
+    shapeParams.materialId = materialId;
 
-    return Geom3D::ShapeFactory::Create(shapeParams);
+    return world.AddShape(shapeParams);
   }
 
-	// init camera
+	// init camera with the placement of the scene, or the default one if the scene does not set it
 	void InitCamera()
 	{
 		// camera
 		float aspect = float(width) / float(height);
-		float verticalFieldOfView = 90.0f;
-		camera.Init(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -0.1f), verticalFieldOfView, aspect);
+		const SceneCamera& sceneCamera = world.Camera();
+		camera.Init(sceneCamera.position, sceneCamera.lookAt, sceneCamera.verticalFieldOfView, aspect);
 	}
 
 	// on rendering ended
@@ -392,6 +937,22 @@ private:
 		// output render ended status and time
 		renderTimeStr = GetTimeStr(renderStart, std::chrono::system_clock::now());
 		printf("Rendering %s!. Render took: %s\n", cancelled ? "CANCELLED" : "DONE", renderTimeStr.c_str());
+		printf("Scene creation took: %s\n", sceneCreationTimeStr.c_str());
+		if (!bvhBuildTimeStr.empty())
+		{
+			printf("BVH build took: %s\n", bvhBuildTimeStr.c_str());
+		}
+
+		if (adaptiveSampling)
+		{
+			uint64_t samplesCount = 0;
+			for (int count : pixelSamplesCount)
+			{
+				samplesCount += count;
+			}
+
+			printf("Adaptive sampling: %.2f samples per pixel on average\n", double(samplesCount) / double(width * height));
+		}
 
 #if PROFILE_HIT_TEST
 		printf("Hit test count: %llu\n", world.GetHitTestCount());
@@ -0,0 +1,135 @@
+#ifndef RAYTRACER_CONFIGURATION_PARSER_H
+#define RAYTRACER_CONFIGURATION_PARSER_H
+
+#include <cstdio>
+#include <string_view>
+
+#include "../CSVParser/CSVParser.h"
+
+#include "Raytracer.h"
+
+// Reads a raytracer configuration file. Every row is a "name,value" pair and rows that are
+// missing in the file keep the value already set in the configuration.
+class RaytracerConfigurationParser
+{
+public:
+
+	static bool Parse(const char* file, RaytracerConfiguration& config)
+	{
+		agarzonp::CSVParser parser(file);
+		if (!parser.IsValid())
+		{
+			return false;
+		}
+
+		ReadInt(parser, "antialiasing samples count", config.antialiasingSamplesCount);
+		ReadInt(parser, "max recursion depth", config.maxRecursionDepth);
+		ReadBool(parser, "russian roulette", config.russianRoulette);
+		ReadInt(parser, "russian roulette min depth", config.russianRouletteMinDepth);
+		ReadBool(parser, "wavefront rendering", config.wavefront);
+		ReadBool(parser, "ray packets", config.rayPackets);
+		ReadInt(parser, "rendering subtasks count", config.renderingSubtasksCount);
+		ReadInt(parser, "tile size", config.tileSize);
+		ReadBool(parser, "use BVH optimisation", config.useBVH);
+		ReadBVHSplitMethod(parser, "BVH split method", config.bvhSplitMethod);
+		ReadInt(parser, "BVH max leaf primitives", config.bvhMaxLeafPrimitives);
+		ReadInt(parser, "BVH width", config.bvhWidth);
+		ReadInt(parser, "sampler seed", config.samplerSeed);
+		ReadBool(parser, "progressive rendering", config.progressive);
+		ReadInt(parser, "samples per pass", config.samplesPerPass);
+		ReadBool(parser, "adaptive sampling", config.adaptiveSampling);
+		ReadInt(parser, "adaptive min samples", config.adaptiveMinSamples);
+		ReadInt(parser, "adaptive max samples", config.adaptiveMaxSamples);
+		ReadFloat(parser, "adaptive error threshold", config.adaptiveErrorThreshold);
+		ReadInt(parser, "random shapes", config.randomShapes);
+		ReadInt(parser, "scene seed", config.sceneSeed);
+
+		return true;
+	}
+
+private:
+
+	// find the value of a row by its name
+	static bool FindValue(const agarzonp::CSVParser& parser, const char* name, std::string_view& value)
+	{
+		for (size_t i = 0; i < parser.NumRows(); i++)
+		{
+			agarzonp::CSVRow row = parser[i];
+			if (row.NumTokens() > 1 && row[0] == name)
+			{
+				value = row[1];
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// values that are not numbers are reported and leave the setting as it was
+	static void ReadInt(const agarzonp::CSVParser& parser, const char* name, int& value)
+	{
+		std::string_view token;
+		int parsedValue = 0;
+		if (FindValue(parser, name, token))
+		{
+			if (Parsing::ParseInt(token, parsedValue))
+			{
+				value = parsedValue;
+			}
+			else
+			{
+				InvalidValue(name, token);
+			}
+		}
+	}
+
+	static void ReadFloat(const agarzonp::CSVParser& parser, const char* name, float& value)
+	{
+		std::string_view token;
+		float parsedValue = 0;
+		if (FindValue(parser, name, token))
+		{
+			if (Parsing::ParseFloat(token, parsedValue))
+			{
+				value = parsedValue;
+			}
+			else
+			{
+				InvalidValue(name, token);
+			}
+		}
+	}
+
+	static void ReadBVHSplitMethod(const agarzonp::CSVParser& parser, const char* name, BVHSplitMethod& value)
+	{
+		std::string_view token;
+		if (FindValue(parser, name, token))
+		{
+			value = token == "Median" ? BVHSplitMethod::MEDIAN : BVHSplitMethod::SAH;
+		}
+	}
+
+	static void ReadBool(const agarzonp::CSVParser& parser, const char* name, bool& value)
+	{
+		std::string_view token;
+		int intValue = 0;
+		if (FindValue(parser, name, token))
+		{
+			if (Parsing::ParseInt(token, intValue))
+			{
+				value = intValue > 0;
+			}
+			else
+			{
+				InvalidValue(name, token);
+			}
+		}
+	}
+
+	static void InvalidValue(const char* name, std::string_view token)
+	{
+		fprintf(stderr, "Invalid value for %s: %.*s\n", name, (int)token.size(), token.data());
+	}
+};
+
+#endif // !RAYTRACER_CONFIGURATION_PARSER_H
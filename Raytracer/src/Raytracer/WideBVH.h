@@ -0,0 +1,277 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "BVH.h"
+#include "../SIMD/SIMD.h"
+
+// Wide BVH node with up to WIDTH children
+// Child bounds are stored in SoA form so a single SIMD slab test checks all the children at once
+template<int WIDTH>
+struct alignas(32) WideBVHNode
+{
+	// child bounds: min x, min y, min z, max x, max y, max z of every child
+	float bounds[6][WIDTH];
+
+	// interior child: index of its node. Leaf child: index of its first primitive
+	uint32_t offsets[WIDTH];
+
+	// number of primitives of a leaf child, 0 for interior children
+	uint16_t primitivesCounts[WIDTH];
+
+	// children are packed at the front, the rest of the slots are unused
+	uint32_t childrenCount;
+
+	// Intersect the ray with every child AABB
+	// Returns a bit per child hit within [minDistance, maxDistance] and stores the child entry distances
+	int Intersect(const Geom3D::Ray& ray, float minDistance, float maxDistance, float* distances) const
+	{
+		int hitMask = 0;
+		int lane = 0;
+
+#if SIMD_AVX
+		for (; lane + 8 <= WIDTH; lane += 8)
+		{
+			__m256 tNear = _mm256_set1_ps(minDistance);
+			__m256 tFar = _mm256_set1_ps(maxDistance);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				__m256 origin = _mm256_set1_ps(ray.Origin()[axis]);
+				__m256 inverseDirection = _mm256_set1_ps(ray.InverseDirection()[axis]);
+				__m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(&bounds[axis][lane]), origin), inverseDirection);
+				__m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(&bounds[axis + 3][lane]), origin), inverseDirection);
+				tNear = _mm256_max_ps(tNear, _mm256_min_ps(t0, t1));
+				tFar = _mm256_min_ps(tFar, _mm256_max_ps(t0, t1));
+			}
+
+			_mm256_storeu_ps(&distances[lane], tNear);
+			hitMask |= _mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ)) << lane;
+		}
+#endif
+
+#if SIMD_SSE
+		for (; lane + 4 <= WIDTH; lane += 4)
+		{
+			__m128 tNear = _mm_set1_ps(minDistance);
+			__m128 tFar = _mm_set1_ps(maxDistance);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				__m128 origin = _mm_set1_ps(ray.Origin()[axis]);
+				__m128 inverseDirection = _mm_set1_ps(ray.InverseDirection()[axis]);
+				__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&bounds[axis][lane]), origin), inverseDirection);
+				__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&bounds[axis + 3][lane]), origin), inverseDirection);
+				tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+				tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+			}
+
+			_mm_storeu_ps(&distances[lane], tNear);
+			hitMask |= _mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) << lane;
+		}
+#endif
+
+		// scalar fallback
+		for (; lane < WIDTH; lane++)
+		{
+			float tNear = minDistance;
+			float tFar = maxDistance;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				float t0 = (bounds[axis][lane] - ray.Origin()[axis]) * ray.InverseDirection()[axis];
+				float t1 = (bounds[axis + 3][lane] - ray.Origin()[axis]) * ray.InverseDirection()[axis];
+				tNear = std::max(tNear, std::min(t0, t1));
+				tFar = std::min(tFar, std::max(t0, t1));
+			}
+
+			distances[lane] = tNear;
+			hitMask |= (tNear <= tFar ? 1 : 0) << lane;
+		}
+
+		// ignore the unused slots
+		return hitMask & ((1 << childrenCount) - 1);
+	}
+};
+
+// Wide BVH built by collapsing a binary BVH. Every node takes the children of its binary node, then keeps opening
+// the interior child with the largest surface area until it has WIDTH children. Leaves stay inline in their parent
+// and reference the primitives of the binary BVH, so the binary BVH must outlive the wide one.
+// Traversal lives in World::Raycast.
+template<int WIDTH>
+class WideBVH
+{
+	static_assert(WIDTH == 4 || WIDTH == 8, "wide BVH nodes have 4 or 8 children");
+
+	// nodes, the root is the first one
+	SceneVector<WideBVHNode<WIDTH>> nodes;
+
+public:
+
+	// build from a binary BVH
+	void Build(const BVH& bvh)
+	{
+		Clear();
+
+		if (bvh.IsEmpty())
+		{
+			return;
+		}
+
+		nodes.reserve(bvh.Nodes().size() / (WIDTH - 1) + 1);
+		CollapseNode(bvh.Nodes(), 0);
+	}
+
+	// clear
+	void Clear()
+	{
+		nodes.clear();
+	}
+
+	// save/load to/from a snapshot
+	void Save(Snapshot::Writer& writer) const
+	{
+		writer.WriteArray(nodes);
+	}
+
+	bool Load(Snapshot::Reader& reader)
+	{
+		return reader.ReadArray(nodes);
+	}
+
+	// Whether the nodes form a tree no deeper than BVH::MAX_DEPTH whose children are in bounds and whose leaves
+	// reference primitives in [0, primitivesCount), to check loaded snapshots
+	bool IsValid(uint32_t primitivesCount) const
+	{
+		if (nodes.empty())
+		{
+			return true;
+		}
+
+		// every node must be reached once, so shared or cyclic children are rejected
+		std::vector<bool> visited(nodes.size(), false);
+		std::vector<std::pair<uint32_t, int>> stack(1, { 0, 0 });
+		while (!stack.empty())
+		{
+			uint32_t nodeIndex = stack.back().first;
+			int depth = stack.back().second;
+			stack.pop_back();
+
+			if (nodeIndex >= nodes.size() || visited[nodeIndex] || depth >= BVH::MAX_DEPTH)
+			{
+				return false;
+			}
+
+			visited[nodeIndex] = true;
+
+			const WideBVHNode<WIDTH>& node = nodes[nodeIndex];
+			if (node.childrenCount == 0 || node.childrenCount > WIDTH)
+			{
+				return false;
+			}
+
+			for (uint32_t child = 0; child < node.childrenCount; child++)
+			{
+				if (node.primitivesCounts[child] > 0)
+				{
+					if (node.offsets[child] > primitivesCount || node.primitivesCounts[child] > primitivesCount - node.offsets[child])
+					{
+						return false;
+					}
+				}
+				else
+				{
+					stack.push_back({ node.offsets[child], depth + 1 });
+				}
+			}
+		}
+
+		return true;
+	}
+
+	// getters
+	bool IsEmpty() const { return nodes.empty(); }
+	const SceneVector<WideBVHNode<WIDTH>>& Nodes() const { return nodes; }
+
+private:
+
+	// collapse the binary node and its descendants into a wide node and return its index
+	uint32_t CollapseNode(const SceneVector<BVHNode>& binaryNodes, uint32_t binaryIndex)
+	{
+		uint32_t nodeIndex = (uint32_t)nodes.size();
+		nodes.emplace_back();
+
+		// gather the binary nodes that become children of this node
+		uint32_t children[WIDTH];
+		uint32_t childrenCount = 0;
+
+		const BVHNode& binaryNode = binaryNodes[binaryIndex];
+		if (binaryNode.IsLeaf())
+		{
+			// only happens for the root
+			children[childrenCount++] = binaryIndex;
+		}
+		else
+		{
+			children[childrenCount++] = binaryIndex + 1;
+			children[childrenCount++] = binaryNode.offset;
+		}
+
+		while (childrenCount < WIDTH)
+		{
+			// open the interior child with the largest surface area
+			int largest = -1;
+			float largestArea = -1.0f;
+			for (uint32_t i = 0; i < childrenCount; i++)
+			{
+				const BVHNode& child = binaryNodes[children[i]];
+				if (!child.IsLeaf() && child.aabb.SurfaceArea() > largestArea)
+				{
+					largest = (int)i;
+					largestArea = child.aabb.SurfaceArea();
+				}
+			}
+
+			if (largest < 0)
+			{
+				break;
+			}
+
+			uint32_t opened = children[largest];
+			children[largest] = opened + 1;
+			children[childrenCount++] = binaryNodes[opened].offset;
+		}
+
+		// fill the node
+		WideBVHNode<WIDTH> node = {};
+		node.childrenCount = childrenCount;
+		for (uint32_t i = 0; i < childrenCount; i++)
+		{
+			const BVHNode& child = binaryNodes[children[i]];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				node.bounds[axis][i] = child.aabb.Min()[axis];
+				node.bounds[axis + 3][i] = child.aabb.Max()[axis];
+			}
+
+			node.offsets[i] = child.offset;
+			node.primitivesCounts[i] = child.primitivesCount;
+		}
+
+		// interior children
+		for (uint32_t i = 0; i < childrenCount; i++)
+		{
+			if (node.primitivesCounts[i] == 0)
+			{
+				node.offsets[i] = CollapseNode(binaryNodes, children[i]);
+			}
+		}
+
+		// Note: nodes may have been reallocated by the children so access by index
+		nodes[nodeIndex] = node;
+
+		return nodeIndex;
+	}
+};
+
+#endif // !WIDE_BVH_H
@@ -7,6 +7,7 @@
 #include "Input/Input.h"
 
 #include "Raytracer/Raytracer.h"
+#include "Raytracer/RaytracerConfigurationParser.h"
 #include "RaytracerAppMachine/RaytracerAppMachine.h"
 
 class RaytracerApp : public InputListener
@@ -38,42 +39,29 @@ public:
 	{
     // read app configuration from a file
     agarzonp::CSVParser appConfig("config/appConfig.csv");
-    if (!appConfig.IsValid())
+    if (!appConfig.IsValid() || appConfig.NumRows() < 3
+      || !appConfig[0].ToInt(1, width) || !appConfig[1].ToInt(1, height))
     {
       return false;
     }
 
-    width = std::stoi(appConfig[0][1]);
-    height = std::stoi(appConfig[1][1]);
-    title = appConfig[2][1];
+    title = std::string(appConfig[2][1]);
 
     // init pixel buffer
     unsigned numPixels = width * height;
     pixelsBuffer = new float[numPixels * 4]; // 4 -> RGBA
 
 		// read raytracer configuration from a file
-		agarzonp::CSVParser parser("config/raytracer/config1.csv");
-		if (!parser.IsValid())
+		RaytracerConfiguration raytracerConfig;
+		if (!RaytracerConfigurationParser::Parse("config/raytracer/config1.csv", raytracerConfig))
 		{
 			return false;
 		}
 
-    int antialiasingSamples = std::stoi(parser[0][1]);
-		int recursionDepth = std::stoi(parser[1][1]);
-		int numWorkingThreads = std::stoi(parser[2][1]);
-		bool useBVH = std::stoi(parser[3][1]) > 0;
-		int randomShapes = std::stoi(parser[4][1]);
-
 		// init raytracer
-		RaytracerConfiguration raytracerConfig;
 		raytracerConfig.width = width;
 		raytracerConfig.height = height;
     raytracerConfig.buffer = pixelsBuffer;
-    raytracerConfig.antialiasingSamplesCount = antialiasingSamples;
-		raytracerConfig.maxRecursionDepth = recursionDepth;
-		raytracerConfig.renderingSubtasksCount = numWorkingThreads;
-		raytracerConfig.useBVH = useBVH;
-		raytracerConfig.randomShapes = randomShapes;
 		
 		Raytracer::Get().Init(raytracerConfig);
 
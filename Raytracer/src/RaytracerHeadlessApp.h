@@ -0,0 +1,386 @@
+#ifndef RAYTRACER_HEADLESS_APP_H
+#define RAYTRACER_HEADLESS_APP_H
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "CSVParser/CSVParser.h"
+#include "Parsing/ParseNumber.h"
+#include "Image/ImageWriter.h"
+
+#include "Raytracer/Raytracer.h"
+#include "Raytracer/RaytracerConfigurationParser.h"
+
+// Command line front-end for the raytracer. Renders a single frame without any window or OpenGL dependency
+// and writes the result to disk.
+class RaytracerHeadlessApp
+{
+	// config files
+	std::string appConfigPath = "config/appConfig.csv";
+	std::string raytracerConfigPath = "config/raytracer/config1.csv";
+
+	// output image
+	std::string outputPath = "render.ppm";
+
+	// raytracer configuration
+	RaytracerConfiguration raytracerConfig;
+
+	// pixels buffer
+	std::vector<float> pixelsBuffer;
+
+public:
+	RaytracerHeadlessApp() {};
+	~RaytracerHeadlessApp() {};
+
+	// init
+	bool Init(int argc, char** argv)
+	{
+		// config file paths may be overridden from the command line so find them first
+		for (int i = 1; i < argc - 1; i++)
+		{
+			if (strcmp(argv[i], "--app-config") == 0)
+			{
+				appConfigPath = argv[i + 1];
+			}
+			else if (strcmp(argv[i], "--config") == 0)
+			{
+				raytracerConfigPath = argv[i + 1];
+			}
+		}
+
+		// read app configuration from a file
+		agarzonp::CSVParser appConfig(appConfigPath.c_str());
+		if (!appConfig.IsValid() || appConfig.NumRows() < 2
+			|| !appConfig[0].ToInt(1, raytracerConfig.width) || !appConfig[1].ToInt(1, raytracerConfig.height))
+		{
+			fprintf(stderr, "Unable to read app config: %s\n", appConfigPath.c_str());
+			return false;
+		}
+
+		// read raytracer configuration from a file
+		if (!RaytracerConfigurationParser::Parse(raytracerConfigPath.c_str(), raytracerConfig))
+		{
+			fprintf(stderr, "Unable to read raytracer config: %s\n", raytracerConfigPath.c_str());
+			return false;
+		}
+
+		// command line flags take precedence over the config files
+		if (!ParseArgs(argc, argv))
+		{
+			PrintUsage(argv[0]);
+			return false;
+		}
+
+		if (raytracerConfig.width <= 0 || raytracerConfig.height <= 0)
+		{
+			fprintf(stderr, "Invalid image size %dx%d\n", raytracerConfig.width, raytracerConfig.height);
+			return false;
+		}
+
+		if (raytracerConfig.antialiasingSamplesCount <= 0 || raytracerConfig.tileSize <= 0 || raytracerConfig.renderingSubtasksCount <= 0)
+		{
+			fprintf(stderr, "Samples count, tile size and subtasks count must be positive\n");
+			return false;
+		}
+
+		// init pixel buffer
+		pixelsBuffer.assign(raytracerConfig.width * raytracerConfig.height * 4, 0.0f); // 4 -> RGBA
+		raytracerConfig.buffer = pixelsBuffer.data();
+
+		// init raytracer
+		Raytracer::Get().Init(raytracerConfig);
+
+		return true;
+	}
+
+	// render a frame in the calling thread and save it
+	bool Run()
+	{
+		Raytracer::Get().Render();
+
+		if (!ImageWriter::WritePPM(outputPath.c_str(), raytracerConfig.width, raytracerConfig.height, pixelsBuffer.data()))
+		{
+			fprintf(stderr, "Unable to write image: %s\n", outputPath.c_str());
+			return false;
+		}
+
+		printf("Image saved to %s\n", outputPath.c_str());
+		return true;
+	}
+
+private:
+
+	// parse command line flags
+	bool ParseArgs(int argc, char** argv)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const char* arg = argv[i];
+			if (strcmp(arg, "--help") == 0 || i + 1 >= argc)
+			{
+				return false;
+			}
+
+			const char* value = argv[++i];
+			if (strcmp(arg, "--app-config") == 0 || strcmp(arg, "--config") == 0)
+			{
+				// already handled
+			}
+			else if (strcmp(arg, "--output") == 0)
+			{
+				outputPath = value;
+			}
+			else if (strcmp(arg, "--width") == 0)
+			{
+				if (!ReadInt(arg, value, raytracerConfig.width))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--height") == 0)
+			{
+				if (!ReadInt(arg, value, raytracerConfig.height))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--samples") == 0)
+			{
+				if (!ReadInt(arg, value, raytracerConfig.antialiasingSamplesCount))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--depth") == 0)
+			{
+				if (!ReadInt(arg, value, raytracerConfig.maxRecursionDepth))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--russian-roulette") == 0)
+			{
+				if (!ReadBool(arg, value, raytracerConfig.russianRoulette))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--wavefront") == 0)
+			{
+				if (!ReadBool(arg, value, raytracerConfig.wavefront))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--ray-packets") == 0)
+			{
+				if (!ReadBool(arg, value, raytracerConfig.rayPackets))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--subtasks") == 0)
+			{
+				if (!ReadInt(arg, value, raytracerConfig.renderingSubtasksCount))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--progressive") == 0)
+			{
+				if (!ReadBool(arg, value, raytracerConfig.progressive))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--samples-per-pass") == 0)
+			{
+				if (!ReadInt(arg, value, raytracerConfig.samplesPerPass))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--adaptive") == 0)
+			{
+				if (!ReadBool(arg, value, raytracerConfig.adaptiveSampling))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--min-samples") == 0)
+			{
+				if (!ReadInt(arg, value, raytracerConfig.adaptiveMinSamples))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--max-samples") == 0)
+			{
+				if (!ReadInt(arg, value, raytracerConfig.adaptiveMaxSamples))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--error-threshold") == 0)
+			{
+				if (!ReadFloat(arg, value, raytracerConfig.adaptiveErrorThreshold))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--tile-size") == 0)
+			{
+				if (!ReadInt(arg, value, raytracerConfig.tileSize))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--bvh") == 0)
+			{
+				if (!ReadBool(arg, value, raytracerConfig.useBVH))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--bvh-split") == 0)
+			{
+				raytracerConfig.bvhSplitMethod = strcmp(value, "Median") == 0 ? BVHSplitMethod::MEDIAN : BVHSplitMethod::SAH;
+			}
+			else if (strcmp(arg, "--bvh-leaf-size") == 0)
+			{
+				if (!ReadInt(arg, value, raytracerConfig.bvhMaxLeafPrimitives))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--bvh-width") == 0)
+			{
+				if (!ReadInt(arg, value, raytracerConfig.bvhWidth))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--seed") == 0)
+			{
+				if (!ReadInt(arg, value, raytracerConfig.samplerSeed))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--shapes") == 0)
+			{
+				if (!ReadInt(arg, value, raytracerConfig.randomShapes))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--scene-seed") == 0)
+			{
+				if (!ReadInt(arg, value, raytracerConfig.sceneSeed))
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--scene") == 0)
+			{
+				raytracerConfig.sceneId = value;
+			}
+			else if (strcmp(arg, "--load-snapshot") == 0)
+			{
+				raytracerConfig.sceneSnapshot = value;
+			}
+			else if (strcmp(arg, "--save-snapshot") == 0)
+			{
+				raytracerConfig.saveSceneSnapshot = value;
+			}
+			else
+			{
+				fprintf(stderr, "Unknown option: %s\n", arg);
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// numeric flag values. Invalid values are reported and leave the setting as it was
+	static bool ReadInt(const char* arg, const char* value, int& setting)
+	{
+		int parsed = 0;
+		if (!Parsing::ParseInt(std::string_view(value), parsed))
+		{
+			return InvalidValue(arg, value);
+		}
+
+		setting = parsed;
+		return true;
+	}
+
+	static bool ReadFloat(const char* arg, const char* value, float& setting)
+	{
+		float parsed = 0.0f;
+		if (!Parsing::ParseFloat(std::string_view(value), parsed))
+		{
+			return InvalidValue(arg, value);
+		}
+
+		setting = parsed;
+		return true;
+	}
+
+	static bool ReadBool(const char* arg, const char* value, bool& setting)
+	{
+		int parsed = 0;
+		if (!ReadInt(arg, value, parsed))
+		{
+			return false;
+		}
+
+		setting = parsed > 0;
+		return true;
+	}
+
+	static bool InvalidValue(const char* arg, const char* value)
+	{
+		fprintf(stderr, "Invalid value for %s: %s\n", arg, value);
+		return false;
+	}
+
+	// print usage
+	void PrintUsage(const char* program)
+	{
+		printf("Usage: %s [options]\n", program);
+		printf("  --app-config <file>   app config csv (default: config/appConfig.csv)\n");
+		printf("  --config <file>       raytracer config csv (default: config/raytracer/config1.csv)\n");
+		printf("  --output <file>       output image (default: render.ppm)\n");
+		printf("  --width <n>           image width\n");
+		printf("  --height <n>          image height\n");
+		printf("  --samples <n>         antialiasing samples count\n");
+		printf("  --depth <n>           max recursion depth\n");
+		printf("  --russian-roulette <0|1> russian roulette path termination\n");
+		printf("  --wavefront <0|1>     wavefront (breadth first) path tracing\n");
+		printf("  --ray-packets <0|1>   trace coherent rays in packets\n");
+		printf("  --subtasks <n>        rendering subtasks count\n");
+		printf("  --progressive <0|1>   progressive rendering\n");
+		printf("  --samples-per-pass <n> samples added to each pixel on every progressive pass\n");
+		printf("  --adaptive <0|1>      adaptive sampling\n");
+		printf("  --min-samples <n>     adaptive sampling min samples per pixel\n");
+		printf("  --max-samples <n>     adaptive sampling max samples per pixel\n");
+		printf("  --error-threshold <f> adaptive sampling relative error threshold\n");
+		printf("  --tile-size <n>       tile size in pixels\n");
+		printf("  --bvh <0|1>           use BVH optimisation\n");
+		printf("  --bvh-split <SAH|Median> BVH split method\n");
+		printf("  --bvh-leaf-size <n>   BVH max leaf primitives\n");
+		printf("  --bvh-width <2|4|8>   BVH children per node\n");
+		printf("  --seed <n>            sampler seed\n");
+		printf("  --shapes <n>          random shapes\n");
+		printf("  --scene-seed <n>      random scene seed\n");
+		printf("  --scene <id>          scene file, or name of a scene in config/scenes, to load instead of a random one\n");
+		printf("  --load-snapshot <file> read the scene and its BVH back from a snapshot\n");
+		printf("  --save-snapshot <file> save the scene and its BVH to a snapshot\n");
+	}
+};
+
+#endif // !RAYTRACER_HEADLESS_APP_H
@@ -0,0 +1,144 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+
+// SIMD instruction sets available to the build
+// SSE2 is part of x86-64. AVX has to be enabled when compiling (see the RAYTRACER_AVX2 CMake option)
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_AVX 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_SSE 1
+#endif
+
+// Float vector as wide as the best instruction set available, so kernels are written once for AVX, SSE and scalar builds
+namespace SIMD
+{
+#if SIMD_AVX
+
+	struct Mask
+	{
+		__m256 v;
+	};
+
+	struct Float
+	{
+		static const int LANES = 8;
+
+		__m256 v;
+
+		Float() = default;
+		Float(__m256 v_) : v(v_) {}
+		Float(float f) : v(_mm256_set1_ps(f)) {}
+
+		static Float Load(const float* p) { return _mm256_loadu_ps(p); }
+		void Store(float* p) const { _mm256_storeu_ps(p, v); }
+	};
+
+	inline Float operator+(const Float& a, const Float& b) { return _mm256_add_ps(a.v, b.v); }
+	inline Float operator-(const Float& a, const Float& b) { return _mm256_sub_ps(a.v, b.v); }
+	inline Float operator*(const Float& a, const Float& b) { return _mm256_mul_ps(a.v, b.v); }
+	inline Float operator/(const Float& a, const Float& b) { return _mm256_div_ps(a.v, b.v); }
+	inline Float Min(const Float& a, const Float& b) { return _mm256_min_ps(a.v, b.v); }
+	inline Float Max(const Float& a, const Float& b) { return _mm256_max_ps(a.v, b.v); }
+	inline Float Sqrt(const Float& a) { return _mm256_sqrt_ps(a.v); }
+
+	inline Mask operator<=(const Float& a, const Float& b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+	inline Mask operator>=(const Float& a, const Float& b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+	inline Mask operator>(const Float& a, const Float& b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+	inline Mask operator&(const Mask& a, const Mask& b) { return { _mm256_and_ps(a.v, b.v) }; }
+
+	// a where the mask is set, b elsewhere
+	inline Float Select(const Mask& mask, const Float& a, const Float& b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+
+	// a bit per lane
+	inline int MoveMask(const Mask& mask) { return _mm256_movemask_ps(mask.v); }
+
+#elif SIMD_SSE
+
+	struct Mask
+	{
+		__m128 v;
+	};
+
+	struct Float
+	{
+		static const int LANES = 4;
+
+		__m128 v;
+
+		Float() = default;
+		Float(__m128 v_) : v(v_) {}
+		Float(float f) : v(_mm_set1_ps(f)) {}
+
+		static Float Load(const float* p) { return _mm_loadu_ps(p); }
+		void Store(float* p) const { _mm_storeu_ps(p, v); }
+	};
+
+	inline Float operator+(const Float& a, const Float& b) { return _mm_add_ps(a.v, b.v); }
+	inline Float operator-(const Float& a, const Float& b) { return _mm_sub_ps(a.v, b.v); }
+	inline Float operator*(const Float& a, const Float& b) { return _mm_mul_ps(a.v, b.v); }
+	inline Float operator/(const Float& a, const Float& b) { return _mm_div_ps(a.v, b.v); }
+	inline Float Min(const Float& a, const Float& b) { return _mm_min_ps(a.v, b.v); }
+	inline Float Max(const Float& a, const Float& b) { return _mm_max_ps(a.v, b.v); }
+	inline Float Sqrt(const Float& a) { return _mm_sqrt_ps(a.v); }
+
+	inline Mask operator<=(const Float& a, const Float& b) { return { _mm_cmple_ps(a.v, b.v) }; }
+	inline Mask operator>=(const Float& a, const Float& b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+	inline Mask operator>(const Float& a, const Float& b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+	inline Mask operator&(const Mask& a, const Mask& b) { return { _mm_and_ps(a.v, b.v) }; }
+
+	// a where the mask is set, b elsewhere
+	inline Float Select(const Mask& mask, const Float& a, const Float& b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+
+	// a bit per lane
+	inline int MoveMask(const Mask& mask) { return _mm_movemask_ps(mask.v); }
+
+#else
+
+	struct Mask
+	{
+		bool v;
+	};
+
+	struct Float
+	{
+		static const int LANES = 1;
+
+		float v;
+
+		Float() = default;
+		Float(float f) : v(f) {}
+
+		static Float Load(const float* p) { return *p; }
+		void Store(float* p) const { *p = v; }
+	};
+
+	inline Float operator+(const Float& a, const Float& b) { return a.v + b.v; }
+	inline Float operator-(const Float& a, const Float& b) { return a.v - b.v; }
+	inline Float operator*(const Float& a, const Float& b) { return a.v * b.v; }
+	inline Float operator/(const Float& a, const Float& b) { return a.v / b.v; }
+	inline Float Min(const Float& a, const Float& b) { return b.v < a.v ? b.v : a.v; }
+	inline Float Max(const Float& a, const Float& b) { return a.v < b.v ? b.v : a.v; }
+	inline Float Sqrt(const Float& a) { return sqrtf(a.v); }
+
+	inline Mask operator<=(const Float& a, const Float& b) { return { a.v <= b.v }; }
+	inline Mask operator>=(const Float& a, const Float& b) { return { a.v >= b.v }; }
+	inline Mask operator>(const Float& a, const Float& b) { return { a.v > b.v }; }
+	inline Mask operator&(const Mask& a, const Mask& b) { return { a.v && b.v }; }
+
+	// a where the mask is set, b elsewhere
+	inline Float Select(const Mask& mask, const Float& a, const Float& b) { return mask.v ? a : b; }
+
+	// a bit per lane
+	inline int MoveMask(const Mask& mask) { return mask.v ? 1 : 0; }
+
+#endif
+}
+
+#endif // !SIMD_H
@@ -0,0 +1,71 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+
+#include "glm/glm.hpp"
+
+// Counter based random number generation.
+//
+// A sampler holds no generator state shared between threads: every random number is a hash of
+// (seed, pixel, sample, dimension), where dimension is just a counter of the numbers drawn so far by the path.
+// The same pixel sample gets the same numbers no matter which thread renders it or in which order.
+class Sampler
+{
+	// key of the pixel sample stream
+	uint32_t key = 0;
+
+	// next dimension to draw
+	uint32_t dimension = 0;
+
+public:
+
+	Sampler() {}
+
+	Sampler(uint32_t seed, uint32_t pixelIndex, uint32_t sampleIndex)
+		: key(Hash(seed ^ Hash(pixelIndex ^ Hash(sampleIndex))))
+	{
+	}
+
+	// uniform float in [0, 1)
+	float Next1D()
+	{
+		uint32_t bits = Hash(key + 0x9E3779B9u * dimension++);
+
+		// use the top 24 bits so the result is exactly representable and never rounds up to 1
+		return float(bits >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// uniform point in [0, 1)^2
+	glm::vec2 Next2D()
+	{
+		float u = Next1D();
+		float v = Next1D();
+		return glm::vec2(u, v);
+	}
+
+	// uniform point inside the unit sphere
+	glm::vec3 NextInUnitSphere()
+	{
+		glm::vec3 p;
+		do
+		{
+			p.x = Next1D() * 2.0f - 1.0f;
+			p.y = Next1D() * 2.0f - 1.0f;
+			p.z = Next1D() * 2.0f - 1.0f;
+
+		} while (glm::dot(p, p) >= 1.0f);
+
+		return p;
+	}
+
+	// PCG output permutation used as a 32 bit hash (Jarzynski and Olano, "Hash Functions for GPU Rendering")
+	static uint32_t Hash(uint32_t value)
+	{
+		uint32_t state = value * 747796405u + 2891336453u;
+		uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+		return (word >> 22u) ^ word;
+	}
+};
+
+#endif // !SAMPLER_H
@@ -0,0 +1,199 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "../Memory/MappedFile.h"
+
+// Binary snapshots: a header followed by raw values and arrays, written and read back in the same order.
+// Arrays start 64 bytes aligned so they can be copied straight out of the memory mapped file.
+// Snapshots store the in-memory layout as is, so they are only meant to be read by the same build on the same platform.
+namespace Snapshot
+{
+	// magic at the start of every snapshot
+	static const char MAGIC[8] = { 'R', 'T', 'S', 'N', 'A', 'P', 'S', 'H' };
+
+	// alignment of arrays within the file
+	static const uint64_t ALIGNMENT = 64;
+
+	// Writes a snapshot to a file
+	class Writer
+	{
+		FILE* file = nullptr;
+		uint64_t offset = 0;
+		bool failed = false;
+
+	public:
+
+		Writer() {};
+		~Writer() { Close(); }
+
+		Writer(const Writer& other) = delete;
+		Writer& operator=(const Writer& other) = delete;
+
+		// create the file and write the header
+		bool Open(const char* path, uint32_t version)
+		{
+			Close();
+
+			file = fopen(path, "wb");
+			if (!file)
+			{
+				return false;
+			}
+
+			offset = 0;
+			failed = false;
+			WriteBytes(MAGIC, sizeof(MAGIC));
+			Write(version);
+			return !failed;
+		}
+
+		// close the file. Returns false if any write failed
+		bool Close()
+		{
+			if (file && fclose(file) != 0)
+			{
+				failed = true;
+			}
+			file = nullptr;
+
+			return !failed;
+		}
+
+		// write a value
+		template<typename T>
+		void Write(const T& value)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types can be stored in a snapshot");
+			WriteBytes(&value, sizeof(T));
+		}
+
+		// write an array: its size, then its elements aligned
+		template<typename T, typename Allocator>
+		void WriteArray(const std::vector<T, Allocator>& array)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types can be stored in a snapshot");
+
+			uint64_t count = array.size();
+			Write(count);
+			Align();
+			WriteBytes(array.data(), count * sizeof(T));
+		}
+
+	private:
+
+		void WriteBytes(const void* bytes, uint64_t size)
+		{
+			if (size == 0 || failed)
+			{
+				return;
+			}
+
+			if (!file)
+			{
+				failed = true;
+				return;
+			}
+
+			if (fwrite(bytes, 1, (size_t)size, file) != size)
+			{
+				failed = true;
+			}
+			offset += size;
+		}
+
+		void Align()
+		{
+			static const char zeros[ALIGNMENT] = {};
+			WriteBytes(zeros, (ALIGNMENT - offset % ALIGNMENT) % ALIGNMENT);
+		}
+	};
+
+	// Reads a snapshot from a memory mapped file
+	// Every read checks it stays within the file and fails otherwise, so truncated files are rejected
+	class Reader
+	{
+		MappedFile file;
+		uint64_t offset = 0;
+
+	public:
+
+		// map the file and check the header
+		bool Open(const char* path, uint32_t version)
+		{
+			offset = 0;
+			if (!file.Open(path))
+			{
+				return false;
+			}
+
+			char magic[sizeof(MAGIC)];
+			uint32_t fileVersion = 0;
+			return ReadBytes(magic, sizeof(magic)) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0 && Read(fileVersion) && fileVersion == version;
+		}
+
+		// unmap the file
+		void Close()
+		{
+			file.Close();
+		}
+
+		// read a value
+		template<typename T>
+		bool Read(T& value)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types can be stored in a snapshot");
+			return ReadBytes(&value, sizeof(T));
+		}
+
+		// read an array
+		template<typename T, typename Allocator>
+		bool ReadArray(std::vector<T, Allocator>& array)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types can be stored in a snapshot");
+
+			uint64_t count = 0;
+			if (!Read(count))
+			{
+				return false;
+			}
+
+			offset += (ALIGNMENT - offset % ALIGNMENT) % ALIGNMENT;
+			if (offset > file.Size() || count > (file.Size() - offset) / sizeof(T))
+			{
+				return false;
+			}
+
+			const T* elements = reinterpret_cast<const T*>(file.Data() + offset);
+			array.assign(elements, elements + count);
+			offset += count * sizeof(T);
+			return true;
+		}
+
+	private:
+
+		bool ReadBytes(void* bytes, uint64_t size)
+		{
+			if (size == 0)
+			{
+				return true;
+			}
+
+			if (offset > file.Size() || size > file.Size() - offset)
+			{
+				return false;
+			}
+
+			memcpy(bytes, file.Data() + offset, (size_t)size);
+			offset += size;
+			return true;
+		}
+	};
+}
+
+#endif // !SNAPSHOT_H
@@ -3,8 +3,11 @@
 
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
 
 #include <deque>
+#include <type_traits>
 #include<vector>
 
 #include "ThreadTask.h"
@@ -61,7 +64,7 @@ public:
 	ThreadTaskResult AddTask(Function&& function)
 	{
 		// wrap the callable object into a packaged_task
-		typedef typename std::result_of<Function()>::type ResultType;
+		typedef std::invoke_result_t<Function> ResultType;
 		std::packaged_task< ResultType() > task(std::move(function));
 
 		// loct the queue
@@ -85,7 +88,9 @@ private:
 	void Init()
 	{
 		// set the pool of worker threads
-		unsigned numWorkerThreads = std::thread::hardware_concurrency() - 1;
+		// Note: keep at least one worker so tasks still run on single core machines
+		unsigned hardwareThreads = std::thread::hardware_concurrency();
+		unsigned numWorkerThreads = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
 		for (unsigned i = 0; i < numWorkerThreads; i++)
 		{
 			workerThreads.push_back(std::thread(&ThreadPool::WorkerThreadLoop, this));
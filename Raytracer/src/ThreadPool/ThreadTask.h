@@ -58,9 +58,9 @@ public:
 	}
 
 	template<typename Function>
-	ThreadTask(Function&& f, int id_)
-		: func(new TaskWrapper<Function>(std::move(f)))
-		, id(id_)
+	ThreadTask(Function&& f, int id)
+		: id_(id)
+		, func(new TaskWrapper<Function>(std::move(f)))
 	{
 	}
 
@@ -1,7 +1,8 @@
 #ifndef THREAD_TASK_RESULT_H
 #define THREAD_TASK_RESULT_H
 
-#include<future>
+#include <chrono>
+#include <future>
 
 class ThreadTaskResult
 {
@@ -14,9 +15,11 @@ class ThreadTaskResult
 	{
 		virtual ~TaskResult() {}
 		virtual void* WaitForResult() = 0;
+		virtual bool IsReady() = 0;
 	};
 
-	template <typename T>
+	// Note: Dummy parameter allows the void partial specialization below to live in class scope
+	template <typename T, typename Dummy = void>
 	struct TaskResultWrapper : public TaskResult
 	{
 		TaskResultWrapper() = default;
@@ -32,6 +35,7 @@ class ThreadTaskResult
 		{
 			future = std::move(other.future);
 			result = std::move(other.result);
+			return *this;
 		}
 
 		void* WaitForResult() override
@@ -40,7 +44,11 @@ class ThreadTaskResult
 			return &result;
 		}
 
-		template<typename T>
+		bool IsReady() override
+		{
+			return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+		}
+
 		T Get()
 		{
 			return future.get();
@@ -51,8 +59,8 @@ class ThreadTaskResult
 	};
 
 	// Template specialization to handle void type
-	template <>
-	struct TaskResultWrapper<void> : public TaskResult
+	template <typename Dummy>
+	struct TaskResultWrapper<void, Dummy> : public TaskResult
 	{
 		TaskResultWrapper() = default;
 
@@ -66,6 +74,7 @@ class ThreadTaskResult
 		TaskResultWrapper& operator=(TaskResultWrapper&& other)
 		{
 			future = std::move(other.future);
+			return *this;
 		}
 
 		void* WaitForResult() override
@@ -74,6 +83,11 @@ class ThreadTaskResult
 			return nullptr;
 		}
 
+		bool IsReady() override
+		{
+			return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+		}
+
 		void Get()
 		{
 			future.get();
@@ -97,8 +111,8 @@ public:
 
 	template<typename T>
 	ThreadTaskResult(std::future<T>&& future, int taskId_)
-		: result(new TaskResultWrapper<T>(std::move(future)))
-		, taskId(taskId_)
+		: taskId(taskId_)
+		, result(new TaskResultWrapper<T>(std::move(future)))
 	{
 	}
 
@@ -110,6 +124,12 @@ public:
 		return *this;
 	}
 
+	// check if the result is available without blocking. Only valid before WaitForResult
+	bool IsReady()
+	{
+		return result->IsReady();
+	}
+
 	void WaitForResult(void*& out)
 	{
 		//printf("Thread %ull waiting for task %d\n", std::hash<std::thread::id>()(std::this_thread::get_id()), taskId);
@@ -0,0 +1,248 @@
+#ifndef WORK_STEALING_THREAD_POOL_H
+#define WORK_STEALING_THREAD_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include <deque>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "ThreadTask.h"
+#include "ThreadTaskResult.h"
+
+// Thread pool with one task queue per worker thread.
+//
+// Tasks added from a worker thread go to the back of its own queue, tasks added from any other thread are
+// spread round robin across the workers. A worker takes tasks from the back of its own queue and, when it runs
+// out of work, steals from the front of the other queues. Every queue has its own lock so workers only contend
+// when stealing from the same victim.
+class WorkStealingThreadPool
+{
+	// per worker task queue
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<ThreadTask> tasks;
+	};
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+
+	// ThredPool terminate condition
+	std::atomic_bool terminate;
+
+	// worker threads
+	std::vector<std::thread> workerThreads;
+
+	// number of tasks queued but not yet picked by any worker
+	std::atomic<int> pendingTasks;
+
+	// next queue for tasks added from outside the pool
+	std::atomic<unsigned> nextQueue;
+
+	// next task id
+	std::atomic<int> nextTaskId;
+
+	// sleeping workers. Only used to avoid notifying when nobody is waiting
+	std::atomic<int> sleepingWorkers;
+	std::mutex sleepMutex;
+
+	// condition variable to wake up any sleepy worker thread
+	std::condition_variable newTaskCondition;
+
+public:
+
+	WorkStealingThreadPool()
+		: terminate(false)
+		, pendingTasks(0)
+		, nextQueue(0)
+		, nextTaskId(0)
+		, sleepingWorkers(0)
+	{
+		Init();
+	};
+
+	WorkStealingThreadPool(const WorkStealingThreadPool& other) = delete;
+	WorkStealingThreadPool& operator=(const WorkStealingThreadPool& other) = delete;
+
+	~WorkStealingThreadPool()
+	{
+		terminate = true;
+
+		// Wake up all threads so we are able to join all of them
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			newTaskCondition.notify_all();
+		}
+
+		for (auto& t : workerThreads)
+		{
+			if (t.joinable())
+			{
+				t.join();
+			}
+		}
+	};
+
+	// number of worker threads
+	unsigned NumWorkerThreads() const { return (unsigned)workerThreads.size(); }
+
+	// Add a task to the queue
+	template<typename Function>
+	ThreadTaskResult AddTask(Function&& function)
+	{
+		// wrap the callable object into a packaged_task
+		typedef std::invoke_result_t<Function> ResultType;
+		std::packaged_task< ResultType() > task(std::move(function));
+
+		// store the future result
+		ThreadTaskResult taskResult(task.get_future(), nextTaskId++);
+
+		// push to the current worker queue or, if added from outside the pool, to the next queue in turn
+		int worker = CurrentWorkerIndex();
+		unsigned queueIndex = worker >= 0 ? (unsigned)worker : nextQueue++ % queues.size();
+
+		{
+			WorkerQueue& queue = *queues[queueIndex];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.push_back(ThreadTask(std::move(task)));
+		}
+
+		pendingTasks++;
+
+		// notify to one thread waiting on new task condition
+		if (sleepingWorkers > 0)
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			newTaskCondition.notify_one();
+		}
+
+		return taskResult;
+	}
+
+	// Wait for a task to be done running other pending tasks meanwhile
+	// Note: this way tasks can add subtasks and wait for them without blocking the worker thread they run on
+	void WaitForTask(ThreadTaskResult& taskResult)
+	{
+		while (!taskResult.IsReady())
+		{
+			ThreadTask task;
+			int worker = CurrentWorkerIndex();
+			if (PopTask(worker >= 0 ? (unsigned)worker : 0, task))
+			{
+				task.Do();
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		void* result = nullptr;
+		taskResult.WaitForResult(result);
+	}
+
+private:
+
+	// Init the thread pool
+	void Init()
+	{
+		// set the pool of worker threads
+		// Note: keep at least one worker so tasks still run on single core machines
+		unsigned hardwareThreads = std::thread::hardware_concurrency();
+		unsigned numWorkerThreads = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+
+		// all the queues must exist before any worker starts stealing
+		for (unsigned i = 0; i < numWorkerThreads; i++)
+		{
+			queues.emplace_back(new WorkerQueue());
+		}
+
+		for (unsigned i = 0; i < numWorkerThreads; i++)
+		{
+			workerThreads.push_back(std::thread(&WorkStealingThreadPool::WorkerThreadLoop, this, i));
+		}
+	}
+
+	// Worker index of the calling thread in this pool or -1 if it is not one of its workers
+	int CurrentWorkerIndex() const
+	{
+		return CurrentWorkerPool() == this ? CurrentWorkerSlot() : -1;
+	}
+
+	static const WorkStealingThreadPool*& CurrentWorkerPool()
+	{
+		thread_local const WorkStealingThreadPool* pool = nullptr;
+		return pool;
+	}
+
+	static int& CurrentWorkerSlot()
+	{
+		thread_local int slot = -1;
+		return slot;
+	}
+
+	// Take a task from the back of our own queue or steal one from the front of any other
+	bool PopTask(unsigned workerIndex, ThreadTask& task)
+	{
+		{
+			WorkerQueue& queue = *queues[workerIndex];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (!queue.tasks.empty())
+			{
+				task = std::move(queue.tasks.back());
+				queue.tasks.pop_back();
+				pendingTasks--;
+				return true;
+			}
+		}
+
+		for (size_t i = 1; i < queues.size(); i++)
+		{
+			WorkerQueue& victim = *queues[(workerIndex + i) % queues.size()];
+
+			// skip victims that are busy, we will come back to them if there is still pending work
+			std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+			if (lock.owns_lock() && !victim.tasks.empty())
+			{
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				pendingTasks--;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Function that workers thread will be executing
+	void WorkerThreadLoop(unsigned workerIndex)
+	{
+		CurrentWorkerPool() = this;
+		CurrentWorkerSlot() = workerIndex;
+
+		while (!terminate)
+		{
+			ThreadTask task;
+			if (PopTask(workerIndex, task))
+			{
+				// do the task
+				task.Do();
+				continue;
+			}
+
+			// Wait until there is a new task
+			// Note: sleepingWorkers is raised before checking pendingTasks and AddTask raises pendingTasks before
+			// checking sleepingWorkers, so either the worker sees the new task or the producer sees the sleeper
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			sleepingWorkers++;
+			newTaskCondition.wait(lock, [this]() { return pendingTasks > 0 || terminate; });
+			sleepingWorkers--;
+		}
+	}
+};
+
+#endif // !WORK_STEALING_THREAD_POOL_H
@@ -0,0 +1,71 @@
+#ifndef SCENE_GENERATOR_H
+#define SCENE_GENERATOR_H
+
+#include <cstdint>
+
+#include "World.h"
+#include "../Sampler/Sampler.h"
+#include "../ThreadPool/WorkStealingThreadPool.h"
+
+// Procedural random scenes for benchmarks
+//
+// Every random number is drawn from a counter based sampler keyed by the seed and the index of what it generates,
+// so sphere i only depends on (seed, i). Spheres are generated in parallel straight into the world arrays and the
+// same seed always gives the same scene, whatever the number of threads.
+// Spheres share a small palette of random materials instead of having one each.
+class SceneGenerator
+{
+	// number of random materials spheres pick from
+	static const uint32_t MATERIALS_COUNT = 256;
+
+	// sampler streams
+	static const uint32_t MATERIAL_STREAM = 0;
+	static const uint32_t SPHERE_STREAM = 1;
+
+public:
+
+	// add spheresCount random spheres to the world
+	static void Generate(World& world, uint32_t spheresCount, uint32_t seed, WorkStealingThreadPool* threadPool = nullptr)
+	{
+		if (spheresCount == 0)
+		{
+			return;
+		}
+
+		// random materials, one in five is metal
+		MaterialId materialIds[MATERIALS_COUNT];
+		for (uint32_t i = 0; i < MATERIALS_COUNT; i++)
+		{
+			Sampler random(seed, i, MATERIAL_STREAM);
+			glm::vec3 attenuation;
+			attenuation.x = random.Next1D();
+			attenuation.y = random.Next1D();
+			attenuation.z = random.Next1D();
+			MaterialType type = random.Next1D() < 0.2f ? MaterialType::METAL : MaterialType::DIFFUSE;
+			materialIds[i] = world.AddMaterial(Material(type, attenuation));
+		}
+
+		// random spheres in the same volume and with the same sizes random scenes always had
+		world.AddSpheres(spheresCount, [seed, &materialIds](uint32_t i)
+		{
+			Sampler random(seed, i, SPHERE_STREAM);
+			// Note: numbers are drawn in separate statements, the order arguments are evaluated in is unspecified
+			glm::vec3 center;
+			center.x = Lerp(-2.0f, 2.0f, random.Next1D());
+			center.y = Lerp(-1.0f, 0.0f, random.Next1D());
+			center.z = Lerp(-10.0f, 5.0f, random.Next1D());
+			float radius = Lerp(0.01f, 0.1f, random.Next1D());
+			MaterialId materialId = materialIds[uint32_t(random.Next1D() * MATERIALS_COUNT)];
+			return Geom3D::Sphere(center, radius, materialId);
+		}, threadPool);
+	}
+
+private:
+
+	static float Lerp(float a, float b, float t)
+	{
+		return a + (b - a) * t;
+	}
+};
+
+#endif // !SCENE_GENERATOR_H
@@ -0,0 +1,307 @@
+#ifndef SCENE_LOADER_H
+#define SCENE_LOADER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+
+#include "World.h"
+#include "../Memory/MappedFile.h"
+#include "../Parsing/ParseNumber.h"
+
+// Loads a text scene file into a world
+//
+// Each line is a directive followed by its arguments separated by spaces or tabs. '#' starts a comment.
+//   camera <position x y z> <look at x y z> <vertical field of view>
+//   material <name> <Diffuse|Metal> <colour r g b>
+//   sphere <center x y z> <radius> <material name>
+//   plane <point x y z> <normal x y z> <material name>
+//   disk <center x y z> <normal x y z> <radius> <material name>
+// Materials have to be defined before the shapes using them.
+//
+// The file is memory mapped and parsed in place: tokens are views into the mapping and numbers are parsed
+// straight from it, so the only allocations are the growth of the world arrays and one per material name.
+class SceneLoader
+{
+	// tokens of the line being parsed
+	class LineTokens
+	{
+		const char* cursor;
+		const char* end;
+
+	public:
+
+		LineTokens(const char* begin, const char* end_)
+			: cursor(begin)
+			, end(end_)
+		{
+		}
+
+		// next token. Returns false at the end of the line
+		bool Next(std::string_view& token)
+		{
+			SkipSpaces();
+
+			const char* begin = cursor;
+			while (cursor < end && !IsSpace(*cursor))
+			{
+				cursor++;
+			}
+
+			token = std::string_view(begin, cursor - begin);
+			return cursor > begin;
+		}
+
+		// next number, parsed in place
+		bool Next(float& value)
+		{
+			SkipSpaces();
+
+			std::from_chars_result result = Parsing::ParseFloat(cursor, end, value);
+			if (result.ec != std::errc() || (result.ptr < end && !IsSpace(*result.ptr)))
+			{
+				return false;
+			}
+
+			cursor = result.ptr;
+			return true;
+		}
+
+		bool Next(glm::vec3& value)
+		{
+			return Next(value.x) && Next(value.y) && Next(value.z);
+		}
+
+		// whether all the tokens have been read
+		bool AtEnd()
+		{
+			std::string_view token;
+			return !Next(token);
+		}
+
+	private:
+
+		static bool IsSpace(char c)
+		{
+			return c == ' ' || c == '\t' || c == '\r';
+		}
+
+		void SkipSpaces()
+		{
+			while (cursor < end && IsSpace(*cursor))
+			{
+				cursor++;
+			}
+		}
+	};
+
+	World& world;
+	const char* path;
+	uint32_t lineNumber = 0;
+
+	// material ids by name. Names are views into the mapped file
+	std::unordered_map<std::string_view, MaterialId> materialIds;
+
+	SceneLoader(World& world_, const char* path_)
+		: world(world_)
+		, path(path_)
+	{
+	}
+
+public:
+
+	// Load the scene file at path, adding its shapes and materials to the world
+	// Returns false if the file can not be opened or has an invalid line, which is reported to stderr
+	static bool Load(const char* path, World& world)
+	{
+		MappedFile file;
+		if (!file.Open(path))
+		{
+			fprintf(stderr, "Unable to open scene %s\n", path);
+			return false;
+		}
+
+		SceneLoader loader(world, path);
+		return loader.Parse(file.Data(), file.Data() + file.Size());
+	}
+
+private:
+
+	// parse the scene line by line
+	bool Parse(const char* begin, const char* end)
+	{
+		const char* line = begin;
+		while (line < end)
+		{
+			lineNumber++;
+
+			const char* lineEnd = static_cast<const char*>(memchr(line, '\n', end - line));
+			if (!lineEnd)
+			{
+				lineEnd = end;
+			}
+
+			const char* comment = static_cast<const char*>(memchr(line, '#', lineEnd - line));
+			if (!ParseLine(LineTokens(line, comment ? comment : lineEnd)))
+			{
+				return false;
+			}
+
+			line = lineEnd + 1;
+		}
+
+		return true;
+	}
+
+	// parse a line
+	bool ParseLine(LineTokens tokens)
+	{
+		std::string_view directive;
+		if (!tokens.Next(directive))
+		{
+			// empty line
+			return true;
+		}
+
+		if (directive == "sphere")
+		{
+			glm::vec3 center;
+			float radius;
+			MaterialId materialId;
+			if (!tokens.Next(center) || !tokens.Next(radius) || !NextMaterial(tokens, materialId) || !tokens.AtEnd())
+			{
+				return Error("expected: sphere <center x y z> <radius> <material name>");
+			}
+
+			if (!(radius > 0.0f))
+			{
+				return Error("sphere radius must be positive");
+			}
+
+			world.AddShape(Geom3D::Sphere(center, radius, materialId));
+		}
+		else if (directive == "plane")
+		{
+			glm::vec3 point;
+			glm::vec3 normal;
+			MaterialId materialId;
+			if (!tokens.Next(point) || !tokens.Next(normal) || !NextMaterial(tokens, materialId) || !tokens.AtEnd())
+			{
+				return Error("expected: plane <point x y z> <normal x y z> <material name>");
+			}
+
+			if (normal == glm::vec3(0.0f))
+			{
+				return Error("plane normal can not be zero");
+			}
+
+			world.AddShape(Geom3D::Plane(point, normal, materialId));
+		}
+		else if (directive == "disk")
+		{
+			glm::vec3 center;
+			glm::vec3 normal;
+			float radius;
+			MaterialId materialId;
+			if (!tokens.Next(center) || !tokens.Next(normal) || !tokens.Next(radius) || !NextMaterial(tokens, materialId) || !tokens.AtEnd())
+			{
+				return Error("expected: disk <center x y z> <normal x y z> <radius> <material name>");
+			}
+
+			if (normal == glm::vec3(0.0f) || !(radius > 0.0f))
+			{
+				return Error("disk normal can not be zero and its radius must be positive");
+			}
+
+			world.AddShape(Geom3D::Disk(center, normal, radius, materialId));
+		}
+		else if (directive == "material")
+		{
+			std::string_view name;
+			std::string_view type;
+			glm::vec3 colour;
+			if (!tokens.Next(name) || !tokens.Next(type) || !tokens.Next(colour) || !tokens.AtEnd())
+			{
+				return Error("expected: material <name> <Diffuse|Metal> <colour r g b>");
+			}
+
+			MaterialType materialType = MaterialType::COUNT;
+			if (type == "Diffuse")
+			{
+				materialType = MaterialType::DIFFUSE;
+			}
+			else if (type == "Metal")
+			{
+				materialType = MaterialType::METAL;
+			}
+			else
+			{
+				return Error("unknown material type, expected Diffuse or Metal");
+			}
+
+			if (!materialIds.emplace(name, world.AddMaterial(Material(materialType, colour))).second)
+			{
+				return Error("material already defined");
+			}
+		}
+		else if (directive == "camera")
+		{
+			SceneCamera camera;
+			if (!tokens.Next(camera.position) || !tokens.Next(camera.lookAt) || !tokens.Next(camera.verticalFieldOfView) || !tokens.AtEnd())
+			{
+				return Error("expected: camera <position x y z> <look at x y z> <vertical field of view>");
+			}
+
+			if (camera.position == camera.lookAt || !(camera.verticalFieldOfView > 0.0f && camera.verticalFieldOfView < 180.0f))
+			{
+				return Error("camera has to look away from its position with a field of view between 0 and 180 degrees");
+			}
+
+			// the camera basis is built from a fixed up vector
+			glm::vec3 direction = camera.lookAt - camera.position;
+			if (glm::length(glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), direction)) <= 1e-6f * glm::length(direction))
+			{
+				return Error("camera can not look straight up or down");
+			}
+
+			camera.isSet = true;
+			world.SetCamera(camera);
+		}
+		else
+		{
+			return Error("unknown directive");
+		}
+
+		return true;
+	}
+
+	// read a material name and look up its id
+	bool NextMaterial(LineTokens& tokens, MaterialId& materialId)
+	{
+		std::string_view name;
+		if (!tokens.Next(name))
+		{
+			return false;
+		}
+
+		auto material = materialIds.find(name);
+		if (material == materialIds.end())
+		{
+			return false;
+		}
+
+		materialId = material->second;
+		return true;
+	}
+
+	// report an error on the current line
+	bool Error(const char* message)
+	{
+		fprintf(stderr, "%s:%u: %s\n", path, lineNumber, message);
+		return false;
+	}
+};
+
+#endif // !SCENE_LOADER_H
@@ -1,18 +1,54 @@
 #ifndef WORLD_H
 #define	WORLD_H
 
-#include <memory>
+#include <array>
+#include <cstdint>
 #include <vector>
 #include "../Geom3D/Geom3D.h"
+#include "../Geom3D/Shapes/SphereSoA.h"
+#include "../Materials/MaterialTable.h"
 #include "../Raytracer/BVH.h"
+#include "../Raytracer/WideBVH.h"
+#include "../Snapshot/Snapshot.h"
+
+// camera placement set by a scene file
+struct SceneCamera
+{
+	bool isSet = false;
+	glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
+	glm::vec3 lookAt = glm::vec3(0.0f, 0.0f, -0.1f);
+	float verticalFieldOfView = 90.0f;
+};
 
 class World
 {
+	// camera placement of the scene
+	SceneCamera camera;
+
 	// shapes
-	std::vector<std::shared_ptr<Geom3D::Shape>> shapes;
+	Geom3D::ShapeArrays shapes;
+
+	// materials of the shapes
+	MaterialTable materials;
+
+	// shapes packed for SIMD raycasting, in the order of the shapes and in the order of the BVH primitives
+	Geom3D::SphereSoA packedShapes;
+	Geom3D::SphereSoA packedPrimitives;
 
 	// bounding volume hierarchy
 	BVH bvh;
+
+	// Unbounded shapes and shapes whose AABB covers a large part of the scene are kept out of the BVH and tested
+	// before it, so the BVH stays tight around the small shapes and their hits cull its nodes early
+	Geom3D::SphereSoA packedLargeShapes;
+
+	// a bounded shape is large when its AABB surface area is above this ratio of the surface area of the scene AABB
+	static constexpr float LARGE_SHAPE_AREA_RATIO = 0.5f;
+
+	// wide BVHs collapsed from the binary one. Only the one matching bvhWidth is built
+	WideBVH<4> bvh4;
+	WideBVH<8> bvh8;
+	uint32_t bvhWidth = 2;
 	
 	// flag to use the BVH for raycasting
 	bool useBVH = false;
@@ -27,82 +63,571 @@ public:
 	World() {};
 	~World() {};
 
-  // clear
+  // clear, releasing the memory of the scene arrays at once
   void Clear()
   {
-    shapes.clear();
+    shapes = Geom3D::ShapeArrays();
+    packedShapes = Geom3D::SphereSoA();
+    materials = MaterialTable();
+
+    bvh = BVH();
+    packedPrimitives = Geom3D::SphereSoA();
+    packedLargeShapes = Geom3D::SphereSoA();
+    bvh4 = WideBVH<4>();
+    bvh8 = WideBVH<8>();
+    useBVH = false;
+    camera = SceneCamera();
   }
 
 	// add shape
-	std::shared_ptr<Geom3D::Shape> AddShape(std::shared_ptr<Geom3D::Shape> shape)
+	Geom3D::ShapeRef AddShape(const Geom3D::ShapeFactoryParams& params)
+	{
+		Geom3D::ShapeRef shape = Geom3D::ShapeFactory::Create(params, shapes);
+		packedShapes.Add(shapes, shape);
+		return shape;
+	}
+
+	// add a shape built by the caller
+	template<typename ShapeT>
+	Geom3D::ShapeRef AddShape(const ShapeT& shape)
+	{
+		Geom3D::ShapeRef ref = shapes.Add(shape);
+		packedShapes.Add(shapes, ref);
+		return ref;
+	}
+
+	// Add count spheres, sphere i being makeSphere(i)
+	// makeSphere is called in parallel chunks on the thread pool if one is given, so it must be thread safe
+	template<typename MakeSphere>
+	void AddSpheres(uint32_t count, MakeSphere makeSphere, WorkStealingThreadPool* threadPool = nullptr)
+	{
+		uint32_t firstSphere = (uint32_t)shapes.Spheres().size();
+		Geom3D::Sphere* spheres = shapes.AddSpheres(count);
+		uint32_t firstSlot = packedShapes.AddSphereSlots(shapes, count);
+
+		auto makeSpheres = [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				spheres[i] = makeSphere(i);
+				packedShapes.SetSphere(firstSlot + i, firstSphere + i);
+			}
+		};
+
+		// the first chunk runs in the calling thread and the rest as tasks
+		uint32_t chunksCount = threadPool && count >= PARALLEL_MIN_SPHERES ? threadPool->NumWorkerThreads() + 1 : 1;
+		std::vector<ThreadTaskResult> taskResults;
+		for (uint32_t chunk = 1; chunk < chunksCount; chunk++)
+		{
+			uint32_t begin = (uint32_t)((uint64_t)count * chunk / chunksCount);
+			uint32_t end = (uint32_t)((uint64_t)count * (chunk + 1) / chunksCount);
+			taskResults.push_back(threadPool->AddTask([&makeSpheres, begin, end]() { makeSpheres(begin, end); }));
+		}
+
+		makeSpheres(0, count / chunksCount);
+
+		for (auto& taskResult : taskResults)
+		{
+			threadPool->WaitForTask(taskResult);
+		}
+	}
+
+	// shapes
+	const Geom3D::ShapeArrays& Shapes() const { return shapes; }
+
+	// add material. Returns the id shapes refer to it by
+	MaterialId AddMaterial(const Material& material)
+	{
+		return materials.Add(material);
+	}
+
+	// materials
+	const MaterialTable& Materials() const { return materials; }
+
+	// scene camera
+	void SetCamera(const SceneCamera& sceneCamera) { camera = sceneCamera; }
+	const SceneCamera& Camera() const { return camera; }
+
+	// whether raycasts traverse the BVH, and its children per node
+	bool UsesBVH() const { return useBVH; }
+	uint32_t BVHWidth() const { return bvhWidth; }
+
+	// clear the BVH so raycasts test every shape
+	void ClearBVH()
+	{
+		bvh.Clear();
+		packedPrimitives.Clear();
+		packedLargeShapes.Clear();
+		bvh4.Clear();
+		bvh8.Clear();
+		bvhWidth = 2;
+		useBVH = false;
+	}
+
+	// Save the scene and its acceleration structures to a snapshot
+	bool SaveSnapshot(const char* path) const
+	{
+		Snapshot::Writer writer;
+		if (!writer.Open(path, SNAPSHOT_VERSION))
+		{
+			return false;
+		}
+
+		writer.Write(SnapshotLayout());
+		writer.Write(useBVH);
+		writer.Write(bvhWidth);
+		writer.Write(camera);
+
+		shapes.Save(writer);
+		materials.Save(writer);
+		packedShapes.Save(writer);
+		bvh.Save(writer);
+		packedPrimitives.Save(writer);
+		packedLargeShapes.Save(writer);
+		bvh4.Save(writer);
+		bvh8.Save(writer);
+
+		return writer.Close();
+	}
+
+	// Load a snapshot replacing the current scene
+	// The arrays are copied straight out of the mapped file and the saved BVH is used as is, nothing is rebuilt
+	bool LoadSnapshot(const char* path)
+	{
+		Clear();
+
+		Snapshot::Reader reader;
+		std::array<uint32_t, 8> layout;
+		bool loaded = reader.Open(path, SNAPSHOT_VERSION)
+			&& reader.Read(layout) && layout == SnapshotLayout()
+			&& reader.Read(useBVH)
+			&& reader.Read(bvhWidth)
+			&& reader.Read(camera)
+			&& shapes.Load(reader)
+			&& materials.Load(reader)
+			&& packedShapes.Load(reader, shapes)
+			&& bvh.Load(reader)
+			&& packedPrimitives.Load(reader, shapes)
+			&& packedLargeShapes.Load(reader, shapes)
+			&& bvh4.Load(reader)
+			&& bvh8.Load(reader)
+			&& IsSnapshotValid();
+
+		if (!loaded)
+		{
+			Clear();
+		}
+
+		return loaded;
+	}
+
+	// Whether every index of a loaded snapshot is in bounds, so a corrupt or foreign snapshot is rejected instead of
+	// crashing the render
+	bool IsSnapshotValid() const
 	{
-    if (shape)
-    {
-      shapes.push_back(shape);
-      return shapes.back();
-    }
-		
-    return nullptr;
+		uint32_t materialsCount = materials.Size();
+		if (!materials.IsValid() || !shapes.IsValid(materialsCount) || !packedShapes.IsValid(materialsCount)
+			|| !packedPrimitives.IsValid(materialsCount) || !packedLargeShapes.IsValid(materialsCount))
+		{
+			return false;
+		}
+
+		// BVH leaves index the packed primitives
+		uint32_t primitivesCount = packedPrimitives.Size();
+		if (!bvh.IsValid(shapes) || bvh.Primitives().size() != primitivesCount || !bvh4.IsValid(primitivesCount) || !bvh8.IsValid(primitivesCount))
+		{
+			return false;
+		}
+
+		// the BVH used for traversal has to be there
+		if (useBVH && (bvh.IsEmpty() || (bvhWidth == 4 && bvh4.IsEmpty()) || (bvhWidth == 8 && bvh8.IsEmpty())))
+		{
+			return false;
+		}
+
+		return true;
 	}
 
-	// build BVH
-	void BuildBVH()
+	// build BVH, in parallel if a thread pool is given
+	void BuildBVH(const BVHBuildSettings& settings = BVHBuildSettings(), WorkStealingThreadPool* threadPool = nullptr)
 	{
-		bvh.Build(shapes);
-		useBVH = true;
+		// split the large shapes from the ones going into the BVH
+		Geom3D::AABB sceneBounds;
+		for (Geom3D::ShapeRef shape : shapes.Shapes())
+		{
+			if (shapes.IsBounded(shape))
+			{
+				sceneBounds.Grow(shapes.GetAABB(shape));
+			}
+		}
+
+		float largeShapeArea = LARGE_SHAPE_AREA_RATIO * sceneBounds.SurfaceArea();
+
+		SceneVector<Geom3D::ShapeRef> bvhShapes;
+		SceneVector<Geom3D::ShapeRef> largeShapes;
+		bvhShapes.reserve(shapes.Size());
+		for (Geom3D::ShapeRef shape : shapes.Shapes())
+		{
+			if (!shapes.IsBounded(shape) || shapes.GetAABB(shape).SurfaceArea() > largeShapeArea)
+			{
+				largeShapes.push_back(shape);
+			}
+			else
+			{
+				bvhShapes.push_back(shape);
+			}
+		}
+
+		bvh.Build(shapes, bvhShapes, settings, threadPool);
+		packedPrimitives.Build(shapes, bvh.Primitives());
+		packedLargeShapes.Build(shapes, largeShapes);
+		useBVH = !bvh.IsEmpty();
+
+		bvh4.Clear();
+		bvh8.Clear();
+		bvhWidth = settings.width;
+		if (bvhWidth == 4)
+		{
+			bvh4.Build(bvh);
+		}
+		else if (bvhWidth == 8)
+		{
+			bvh8.Build(bvh);
+		}
+		else
+		{
+			bvhWidth = 2;
+		}
 	}
 
 	// raycast
+	// First finds the closest shape keeping only its distance and index, then fills the surface interaction for it
 	bool Raycast(const Geom3D::Ray& ray, float minDistance, float maxDistance, Geom3D::RaycastHit& raycastHit)
 	{
-		Geom3D::RaycastHit tempHit;
-		bool hit = false;
+		// packed shapes holding the closest shape found so far
+		const Geom3D::SphereSoA* closestShapes = nullptr;
+		int closest = -1;
 
 		if (useBVH)
 		{
-			hit = bvh.Raycast(ray, minDistance, maxDistance, raycastHit);
+			if (packedLargeShapes.Intersect(ray, 0, packedLargeShapes.Size(), minDistance, maxDistance, closest))
+			{
+				closestShapes = &packedLargeShapes;
+			}
+
+			#if PROFILE_HIT_TEST
+			hitTestCount += packedLargeShapes.Size();
+			#endif
+
+			bool bvhHit = false;
+			switch (bvhWidth)
+			{
+			case 4: bvhHit = IntersectWideBVH(bvh4, ray, minDistance, maxDistance, closest); break;
+			case 8: bvhHit = IntersectWideBVH(bvh8, ray, minDistance, maxDistance, closest); break;
+			default: bvhHit = IntersectBVH(ray, minDistance, maxDistance, closest); break;
+			}
+
+			if (bvhHit)
+			{
+				closestShapes = &packedPrimitives;
+			}
 		}
 		else
 		{
 			// brute force
-			for (auto& shape : shapes)
+			if (packedShapes.Intersect(ray, 0, packedShapes.Size(), minDistance, maxDistance, closest))
 			{
-				if (shape->Raycast(ray, minDistance, maxDistance, tempHit) && tempHit.hitDistance < raycastHit.hitDistance)
+				closestShapes = &packedShapes;
+			}
+
+			#if PROFILE_HIT_TEST
+			hitTestCount += packedShapes.Size();
+			#endif
+		}
+
+		if (!closestShapes)
+		{
+			return false;
+		}
+
+		// maxDistance ends up being the distance to the closest shape
+		closestShapes->SetHit(ray, (uint32_t)closest, maxDistance, raycastHit);
+		return true;
+	}
+
+
+	// Raycast a packet of rays. Returns a bit per ray that hits something and writes their hits
+	// Packets always traverse the binary BVH, visiting the children in the order of the first ray
+	int RaycastPacket(const Geom3D::RayPacket& packet, float minDistance, float maxDistance, Geom3D::RaycastHit* raycastHits)
+	{
+		int hitMask = 0;
+
+		if (!useBVH)
+		{
+			for (int lane = 0; lane < packet.count; lane++)
+			{
+				hitMask |= (Raycast(packet.rays[lane], minDistance, maxDistance, raycastHits[lane]) ? 1 : 0) << lane;
+			}
+
+			return hitMask;
+		}
+
+		const BVHNode* nodes = bvh.Nodes().data();
+
+		float maxDistances[Geom3D::RayPacket::SIZE];
+		int closestLargeShape[Geom3D::RayPacket::SIZE];
+		int closest[Geom3D::RayPacket::SIZE];
+		for (int lane = 0; lane < Geom3D::RayPacket::SIZE; lane++)
+		{
+			maxDistances[lane] = maxDistance;
+			closestLargeShape[lane] = -1;
+			closest[lane] = -1;
+		}
+
+		// large shapes first, their hits cull the BVH nodes behind them
+		packedLargeShapes.IntersectPacket(packet, 0, packedLargeShapes.Size(), minDistance, maxDistances, closestLargeShape);
+
+		const int* directionIsNegative = packet.rays[0].Sign();
+
+		// nodes still to visit
+		uint32_t stack[BVH::MAX_DEPTH];
+		int stackSize = 0;
+
+		uint32_t nodeIndex = 0;
+		while (true)
+		{
+			const BVHNode& node = nodes[nodeIndex];
+
+			#if PROFILE_HIT_TEST
+			hitTestCount++;
+			#endif
+
+			// visit the node if any ray enters it before its closest hit
+			if (node.aabb.Intersect(packet, minDistance, maxDistances))
+			{
+				if (node.IsLeaf())
 				{
-					raycastHit = tempHit;
-					hit = true;
+					packedPrimitives.IntersectPacket(packet, node.offset, node.offset + node.primitivesCount, minDistance, maxDistances, closest);
+
+					#if PROFILE_HIT_TEST
+					hitTestCount += node.primitivesCount;
+					#endif
 				}
+				else
+				{
+					// visit the nearer child and leave the farther one for later
+					if (directionIsNegative[node.splitAxis])
+					{
+						stack[stackSize++] = nodeIndex + 1;
+						nodeIndex = node.offset;
+					}
+					else
+					{
+						stack[stackSize++] = node.offset;
+						nodeIndex++;
+					}
+					continue;
+				}
+			}
 
-				#if PROFILE_HIT_TEST
-				hitTestCount++;
-				#endif
+			if (stackSize == 0)
+			{
+				break;
+			}
+
+			nodeIndex = stack[--stackSize];
+		}
+
+		// surface interactions of the closest shapes. A BVH primitive is only hit when it is closer than any large shape
+		for (int lane = 0; lane < packet.count; lane++)
+		{
+			if (closest[lane] >= 0)
+			{
+				packedPrimitives.SetHit(packet.rays[lane], (uint32_t)closest[lane], maxDistances[lane], raycastHits[lane]);
+				hitMask |= 1 << lane;
+			}
+			else if (closestLargeShape[lane] >= 0)
+			{
+				packedLargeShapes.SetHit(packet.rays[lane], (uint32_t)closestLargeShape[lane], maxDistances[lane], raycastHits[lane]);
+				hitMask |= 1 << lane;
 			}
 		}
-		
-		return hit;
-	}
 
+		return hitMask;
+	}
 
 #if PROFILE_HIT_TEST
 	// Hit test count
 	void ResetHitTestCount()
 	{
 		hitTestCount = 0;
-
-		if (useBVH)
-		{
-			bvh.ResetHitTestCount();
-		}
-
 	}
 	uint64_t GetHitTestCount() 
 	{ 
-		return  useBVH ? bvh.GetHitTestCount() : hitTestCount; 
+		return hitTestCount; 
 	}
 #endif
 
 private:
 
+	// spheres added in a single chunk below this count
+	static const uint32_t PARALLEL_MIN_SPHERES = 64 * 1024;
+
+	// snapshot version, bump it whenever what is saved changes
+	static const uint32_t SNAPSHOT_VERSION = 2;
+
+	// sizes of the saved types, so snapshots from builds with a different layout are rejected
+	static std::array<uint32_t, 8> SnapshotLayout()
+	{
+		return { { (uint32_t)sizeof(Geom3D::Sphere), (uint32_t)sizeof(Geom3D::Plane), (uint32_t)sizeof(Geom3D::Disk), (uint32_t)sizeof(Geom3D::ShapeRef),
+			(uint32_t)sizeof(Material), (uint32_t)sizeof(BVHNode), (uint32_t)sizeof(WideBVHNode<4>), (uint32_t)sizeof(WideBVHNode<8>) } };
+	}
+
+	// find the closest BVH primitive
+	// Children are visited front to back along the split axis and maxDistance shrinks with every hit,
+	// so nodes entered beyond the closest hit found so far are skipped
+	bool IntersectBVH(const Geom3D::Ray& ray, float minDistance, float& maxDistance, int& closest)
+	{
+		const BVHNode* nodes = bvh.Nodes().data();
+
+		// the nearer child of a node is the right one when the ray goes backwards along its split axis
+		const int* directionIsNegative = ray.Sign();
+
+		// nodes still to visit
+		uint32_t stack[BVH::MAX_DEPTH];
+		int stackSize = 0;
+
+		bool hit = false;
+
+		uint32_t nodeIndex = 0;
+		while (true)
+		{
+			const BVHNode& node = nodes[nodeIndex];
+
+			#if PROFILE_HIT_TEST
+			hitTestCount++;
+			#endif
+
+			float tMin = 0.0f;
+			float tMax = 0.0f;
+			if (node.aabb.Intersect(ray, tMin, tMax) && tMin <= maxDistance && tMax >= minDistance)
+			{
+				if (node.IsLeaf())
+				{
+					// test the primitives against the closest hit found so far
+					if (packedPrimitives.Intersect(ray, node.offset, node.offset + node.primitivesCount, minDistance, maxDistance, closest))
+					{
+						hit = true;
+					}
+
+					#if PROFILE_HIT_TEST
+					hitTestCount += node.primitivesCount;
+					#endif
+				}
+				else
+				{
+					// visit the nearer child and leave the farther one for later
+					if (directionIsNegative[node.splitAxis])
+					{
+						stack[stackSize++] = nodeIndex + 1;
+						nodeIndex = node.offset;
+					}
+					else
+					{
+						stack[stackSize++] = node.offset;
+						nodeIndex++;
+					}
+					continue;
+				}
+			}
+
+			if (stackSize == 0)
+			{
+				break;
+			}
+
+			nodeIndex = stack[--stackSize];
+		}
+
+		return hit;
+	}
+
+	// find the closest primitive of a wide BVH
+	// All the children of a node are tested at once and the ones hit are visited from the nearest to the farthest,
+	// skipping any entered beyond the closest hit found so far
+	template<int WIDTH>
+	bool IntersectWideBVH(const WideBVH<WIDTH>& wideBVH, const Geom3D::Ray& ray, float minDistance, float& maxDistance, int& closest)
+	{
+		const WideBVHNode<WIDTH>* nodes = wideBVH.Nodes().data();
+
+		// children still to visit, nearest on top. Every level leaves at most WIDTH - 1 children behind
+		struct StackEntry
+		{
+			uint32_t offset;
+			uint32_t primitivesCount;
+			float distance;
+		};
+		StackEntry stack[BVH::MAX_DEPTH * WIDTH];
+		int stackSize = 0;
+
+		bool hit = false;
+
+		stack[stackSize++] = { 0, 0, minDistance };
+		while (stackSize > 0)
+		{
+			StackEntry entry = stack[--stackSize];
+			if (entry.distance > maxDistance)
+			{
+				continue;
+			}
+
+			if (entry.primitivesCount > 0)
+			{
+				// test the primitives against the closest hit found so far
+				if (packedPrimitives.Intersect(ray, entry.offset, entry.offset + entry.primitivesCount, minDistance, maxDistance, closest))
+				{
+					hit = true;
+				}
+
+				#if PROFILE_HIT_TEST
+				hitTestCount += entry.primitivesCount;
+				#endif
+				continue;
+			}
+
+			const WideBVHNode<WIDTH>& node = nodes[entry.offset];
+
+			#if PROFILE_HIT_TEST
+			hitTestCount++;
+			#endif
+
+			float distances[WIDTH];
+			int hitMask = node.Intersect(ray, minDistance, maxDistance, distances);
+
+			// push the children hit from the farthest to the nearest so the nearest is visited next
+			int first = stackSize;
+			for (int child = 0; hitMask != 0; child++, hitMask >>= 1)
+			{
+				if ((hitMask & 1) == 0)
+				{
+					continue;
+				}
+
+				StackEntry childEntry = { node.offsets[child], node.primitivesCounts[child], distances[child] };
+
+				int i = stackSize++;
+				while (i > first && stack[i - 1].distance < childEntry.distance)
+				{
+					stack[i] = stack[i - 1];
+					i--;
+				}
+				stack[i] = childEntry;
+			}
+		}
+
+		return hit;
+	}
+
 };
 
 #endif // !WORLD_H
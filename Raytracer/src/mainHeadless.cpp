@@ -0,0 +1,22 @@
+#include <iostream>
+
+#include "RaytracerHeadlessApp.h"
+
+int main(int argc, char** argv)
+{
+	// init RaytracerHeadlessApp
+	RaytracerHeadlessApp raytracerApp;
+	if (!raytracerApp.Init(argc, argv))
+	{
+		std::cerr << "RaytracerHeadlessApp init failed!" << std::endl;
+		return -1;
+	}
+
+	// render and save the image
+	if (!raytracerApp.Run())
+	{
+		return -1;
+	}
+
+	return 0;
+}